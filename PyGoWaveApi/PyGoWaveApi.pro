@@ -37,27 +37,43 @@ DEPENDPATH += src
 INCLUDEPATH += src
 SOURCES += src/model.cpp \
     src/controller.cpp \
-    src/operations.cpp
+    src/operations.cpp \
+    src/metrics.cpp \
+    src/recorder.cpp \
+    src/cache.cpp \
+    src/framedecoder.cpp \
+    src/participantindex.cpp \
+    src/gapbuffer.cpp
 HEADERS += src/model.h \
 	src/model_p.h \
     src/controller.h \
 	src/operations.h \
 	src/operations_p.h \
 	src/controller_p.h \
+	src/metrics.h \
+	src/recorder.h \
+	src/recorder_p.h \
+	src/cache_p.h \
+	src/framedecoder_p.h \
+	src/participantindex_p.h \
+	src/gapbuffer_p.h \
+	src/offsettree_p.h \
 	src/pygowave_api_global.h
 target.path = $$[QT_INSTALL_LIBS]
 dist_headers.path = $$[QT_INSTALL_HEADERS]/PyGoWaveApi
 dist_headers.files = src/model.h \
     src/controller.h \
     src/operations.h \
+    src/metrics.h \
+    src/recorder.h \
 	src/pygowave_api_global.h
-VERSION = 0.3.0
+VERSION = 0.4.0
 INSTALLS += target \
     dist_headers
 macx {
 	CONFIG += lib_bundle
 	FRAMEWORK_HEADERS.version = Versions
-	FRAMEWORK_HEADERS.files = src/model.h src/controller.h src/operations.h src/pygowave_api_global.h
+	FRAMEWORK_HEADERS.files = src/model.h src/controller.h src/operations.h src/metrics.h src/recorder.h src/pygowave_api_global.h
 	FRAMEWORK_HEADERS.path = Headers
 	QMAKE_BUNDLE_DATA += FRAMEWORK_HEADERS
 	TARGET = PyGoWaveApi
@@ -0,0 +1,494 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "cache_p.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDir>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+
+#ifdef Q_OS_WIN
+#  include <io.h>
+#else
+#  include <unistd.h>
+#  include <fcntl.h>
+#endif
+
+using namespace PyGoWave;
+
+const quint32 ParticipantCache::g_magic = 0x50475750; // "PGWP"
+const quint32 ParticipantCache::g_version = 1;
+
+/*!
+	\internal
+	\class PyGoWave::ParticipantCache
+	\brief On-disk store of participant data as received from the server,
+	together with the time it was fetched.
+*/
+
+ParticipantCache::ParticipantCache()
+{
+	this->m_dirty = false;
+}
+
+QString ParticipantCache::fileName() const
+{
+	return this->m_fileName;
+}
+
+/*!
+	Sets the file to load from and save to. Discards all entries.
+*/
+void ParticipantCache::setFileName(const QString &fileName)
+{
+	this->m_fileName = fileName;
+	this->m_entries.clear();
+	this->m_dirty = false;
+}
+
+/*!
+	Loads the entries from the cache file. A missing or unreadable file
+	leaves the cache empty.
+*/
+bool ParticipantCache::load()
+{
+	this->m_entries.clear();
+	this->m_dirty = false;
+	if (this->m_fileName.isEmpty())
+		return false;
+	QFile file(this->m_fileName);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_4_5);
+	quint32 magic = 0, version = 0, count = 0;
+	stream >> magic >> version;
+	if (magic != ParticipantCache::g_magic || version != ParticipantCache::g_version)
+		return false;
+	stream >> count;
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+		QByteArray id;
+		Entry entry;
+		stream >> id >> entry.data >> entry.fetched;
+		if (stream.status() == QDataStream::Ok)
+			this->m_entries.insert(id, entry);
+	}
+	return true;
+}
+
+/*!
+	Writes all entries to the cache file, creating its directory if needed.
+*/
+bool ParticipantCache::save()
+{
+	if (this->m_fileName.isEmpty())
+		return false;
+	QDir().mkpath(QFileInfo(this->m_fileName).absolutePath());
+	QFile file(this->m_fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qWarning("ParticipantCache: Cannot write '%s'!", qPrintable(this->m_fileName));
+		return false;
+	}
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_4_5);
+	stream << ParticipantCache::g_magic << ParticipantCache::g_version << (quint32) this->m_entries.size();
+	QHash<QByteArray, Entry>::const_iterator it;
+	for (it = this->m_entries.constBegin(); it != this->m_entries.constEnd(); ++it)
+		stream << it.key() << it.value().data << it.value().fetched;
+	this->m_dirty = false;
+	return true;
+}
+
+bool ParticipantCache::isDirty() const
+{
+	return this->m_dirty;
+}
+
+bool ParticipantCache::contains(const QByteArray &id) const
+{
+	return this->m_entries.contains(id);
+}
+
+QList<QByteArray> ParticipantCache::ids() const
+{
+	return this->m_entries.keys();
+}
+
+QVariantMap ParticipantCache::data(const QByteArray &id) const
+{
+	return this->m_entries.value(id).data;
+}
+
+/*!
+	Returns true if the entry for \a id has been fetched more than \a ttl
+	seconds ago or does not exist.
+*/
+bool ParticipantCache::isExpired(const QByteArray &id, int ttl) const
+{
+	if (!this->m_entries.contains(id))
+		return true;
+	return this->m_entries.value(id).fetched + (uint) ttl < QDateTime::currentDateTime().toTime_t();
+}
+
+/*!
+	Stores \a data for \a id with the current time.
+*/
+void ParticipantCache::insert(const QByteArray &id, const QVariantMap &data)
+{
+	Entry entry;
+	entry.data = data;
+	entry.fetched = QDateTime::currentDateTime().toTime_t();
+	this->m_entries.insert(id, entry);
+	this->m_dirty = true;
+}
+
+
+const quint32 WaveCache::g_magic = 0x50475743; // "PGWC"
+const quint32 WaveCache::g_version = 1;
+
+/*!
+	\internal
+	\class PyGoWave::WaveCache
+	\brief On-disk store of the wave list and of wavelet snapshots of one
+	user on one server.
+
+	Every item is kept in its own file as a compressed QDataStream. The most
+	recently used snapshots are also kept in memory, even if the directory
+	is not set.
+*/
+
+WaveCache::WaveCache()
+{
+	this->m_snapshots.setMaxCost(32);
+}
+
+QString WaveCache::directory() const
+{
+	return this->m_directory;
+}
+
+/*!
+	Sets the directory of the cache; an empty string disables it.
+*/
+void WaveCache::setDirectory(const QString &directory)
+{
+	if (this->m_directory != directory)
+		this->m_snapshots.clear(); // Belonged to another user or server
+	this->m_directory = directory;
+}
+
+bool WaveCache::isEnabled() const
+{
+	return !this->m_directory.isEmpty();
+}
+
+/*!
+	Reads the cached wave list (the property of the last WAVE_LIST message)
+	and the id of the viewer it belongs to.
+*/
+bool WaveCache::loadWaveList(QByteArray * viewerId, QVariantMap * waveList) const
+{
+	QVariantList data;
+	if (!this->isEnabled() || !WaveCache::readFile(QDir(this->m_directory).filePath("wavelist.dat"), &data) || data.size() != 2)
+		return false;
+	*viewerId = data.at(0).toByteArray();
+	*waveList = data.at(1).toMap();
+	return true;
+}
+
+void WaveCache::saveWaveList(const QByteArray &viewerId, const QVariantMap &waveList)
+{
+	if (!this->isEnabled())
+		return;
+	WaveCache::writeFile(QDir(this->m_directory).filePath("wavelist.dat"), QVariantList() << viewerId << waveList);
+}
+
+/*!
+	Reads the cached snapshot (the property of a WAVELET_OPEN message) of
+	\a waveletId and the wavelet version it represents.
+*/
+bool WaveCache::loadSnapshot(const QByteArray &waveletId, int * version, QVariantMap * snapshot) const
+{
+	Snapshot * entry = this->m_snapshots.object(waveletId);
+	if (!entry) {
+		QVariantList data;
+		if (!this->isEnabled() || !WaveCache::readFile(this->snapshotFileName(waveletId), &data) || data.size() != 2)
+			return false;
+		entry = new Snapshot;
+		entry->version = data.at(0).toInt();
+		entry->data = data.at(1).toMap();
+		this->m_snapshots.insert(waveletId, entry);
+	}
+	*version = entry->version;
+	*snapshot = entry->data;
+	return true;
+}
+
+void WaveCache::saveSnapshot(const QByteArray &waveletId, int version, const QVariantMap &snapshot)
+{
+	Snapshot * entry = new Snapshot;
+	entry->version = version;
+	entry->data = snapshot;
+	this->m_snapshots.insert(waveletId, entry);
+	if (!this->isEnabled())
+		return;
+	WaveCache::writeFile(this->snapshotFileName(waveletId), QVariantList() << version << snapshot);
+}
+
+void WaveCache::removeSnapshot(const QByteArray &waveletId)
+{
+	this->m_snapshots.remove(waveletId);
+	if (this->isEnabled())
+		QFile::remove(this->snapshotFileName(waveletId));
+}
+
+/*!
+	Returns the number of snapshots kept in memory.
+*/
+int WaveCache::memoryCapacity() const
+{
+	return this->m_snapshots.maxCost();
+}
+
+void WaveCache::setMemoryCapacity(int snapshots)
+{
+	this->m_snapshots.setMaxCost(snapshots);
+}
+
+QString WaveCache::snapshotFileName(const QByteArray &waveletId) const
+{
+	// Wavelet ids may contain characters which are not allowed in file names
+	return QDir(this->m_directory).filePath(QString::fromAscii(waveletId.toHex()) + ".snap");
+}
+
+bool WaveCache::readFile(const QString &fileName, QVariantList * data)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_4_5);
+	quint32 magic = 0, version = 0;
+	QByteArray compressed;
+	stream >> magic >> version >> compressed;
+	if (magic != WaveCache::g_magic || version != WaveCache::g_version || stream.status() != QDataStream::Ok)
+		return false;
+	QByteArray raw = qUncompress(compressed);
+	QDataStream rawStream(raw);
+	rawStream.setVersion(QDataStream::Qt_4_5);
+	rawStream >> *data;
+	return rawStream.status() == QDataStream::Ok;
+}
+
+bool WaveCache::writeFile(const QString &fileName, const QVariantList &data)
+{
+	QDir().mkpath(QFileInfo(fileName).absolutePath());
+	QByteArray raw;
+	QDataStream rawStream(&raw, QIODevice::WriteOnly);
+	rawStream.setVersion(QDataStream::Qt_4_5);
+	rawStream << data;
+
+	// Write to a temporary file first, so a crash never leaves a truncated entry
+	QFile file(fileName + ".tmp");
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qWarning("WaveCache: Cannot write '%s'!", qPrintable(fileName));
+		return false;
+	}
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_4_5);
+	stream << WaveCache::g_magic << WaveCache::g_version << qCompress(raw);
+	file.close();
+	QFile::remove(fileName);
+	return QFile::rename(fileName + ".tmp", fileName);
+}
+
+
+// QFile::flush() only hands the data to the operating system
+static void syncFile(QFile &file)
+{
+	file.flush();
+#ifdef Q_OS_WIN
+	::_commit(file.handle());
+#else
+	::fsync(file.handle());
+#endif
+}
+
+// Makes a rename in the directory durable
+static void syncDirectory(const QString &path)
+{
+#ifndef Q_OS_WIN
+	int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+	if (fd != -1) {
+		::fsync(fd);
+		::close(fd);
+	}
+#else
+	Q_UNUSED(path);
+#endif
+}
+
+const quint32 OperationJournal::g_magic = 0x5047574a; // "PGWJ"
+const quint32 OperationJournal::g_version = 1;
+const qint64 OperationJournal::g_compactSize = 256 * 1024;
+
+/*!
+	\internal
+	\class PyGoWave::OperationJournal
+	\brief Append-only files with the unacknowledged operations of wavelets.
+
+	Each record holds the wavelet version the operations are based on, the
+	serialized operations of the pending and cached OpManager and the bundle
+	in flight exactly as it was sent. The last complete record of a wavelet's
+	journal is the valid one; a record torn by a crash is ignored. Records
+	are synced to disk before append() returns.
+*/
+
+QString OperationJournal::directory() const
+{
+	return this->m_directory;
+}
+
+/*!
+	Sets the directory of the journal files; an empty string disables the
+	journal.
+*/
+void OperationJournal::setDirectory(const QString &directory)
+{
+	this->m_directory = directory;
+}
+
+bool OperationJournal::isEnabled() const
+{
+	return !this->m_directory.isEmpty();
+}
+
+/*!
+	Appends a record for \a waveletId and syncs it to disk. Once the file
+	grew too large, it is replaced by one with only this record.
+*/
+void OperationJournal::append(const QByteArray &waveletId, int version, const QVariantList &pending, const QVariantList &cached, const QVariantMap &inflight)
+{
+	if (!this->isEnabled())
+		return;
+	QByteArray record;
+	QDataStream recordStream(&record, QIODevice::WriteOnly);
+	recordStream.setVersion(QDataStream::Qt_4_5);
+	recordStream << (qint32) version << pending << cached << inflight;
+
+	QString fileName = this->journalFileName(waveletId);
+	QDir().mkpath(QFileInfo(fileName).absolutePath());
+	QFileInfo info(fileName);
+	bool fresh = !info.exists() || info.size() > OperationJournal::g_compactSize;
+
+	// A new or compacted journal is written to a temporary file first, so
+	// a crash never loses the records of the old one
+	QFile file(fresh ? fileName + ".tmp" : fileName);
+	if (!file.open(fresh ? QIODevice::WriteOnly | QIODevice::Truncate : QIODevice::WriteOnly | QIODevice::Append)) {
+		qWarning("OperationJournal: Cannot write '%s'!", qPrintable(fileName));
+		return;
+	}
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_4_5);
+	if (fresh)
+		stream << OperationJournal::g_magic << OperationJournal::g_version << waveletId;
+	stream << record;
+	syncFile(file);
+	if (fresh) {
+		file.close();
+		QFile::remove(fileName);
+		if (!QFile::rename(fileName + ".tmp", fileName))
+			qWarning("OperationJournal: Cannot write '%s'!", qPrintable(fileName));
+		syncDirectory(QFileInfo(fileName).absolutePath());
+	}
+}
+
+/*!
+	Reads the last complete record of \a waveletId.
+*/
+bool OperationJournal::load(const QByteArray &waveletId, int * version, QVariantList * pending, QVariantList * cached, QVariantMap * inflight) const
+{
+	if (!this->isEnabled())
+		return false;
+	QFile file(this->journalFileName(waveletId));
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_4_5);
+	quint32 magic = 0, fileVersion = 0;
+	QByteArray id;
+	stream >> magic >> fileVersion >> id;
+	if (magic != OperationJournal::g_magic || fileVersion != OperationJournal::g_version || id != waveletId)
+		return false;
+
+	QByteArray last;
+	while (!stream.atEnd()) {
+		QByteArray record;
+		stream >> record;
+		if (stream.status() != QDataStream::Ok)
+			break; // Torn record
+		last = record;
+	}
+	if (last.isEmpty())
+		return false;
+
+	QDataStream recordStream(last);
+	recordStream.setVersion(QDataStream::Qt_4_5);
+	qint32 v = 0;
+	recordStream >> v >> *pending >> *cached;
+	*version = v;
+	if (recordStream.status() != QDataStream::Ok)
+		return false;
+	recordStream >> *inflight;
+	if (recordStream.status() != QDataStream::Ok)
+		inflight->clear(); // Records of older versions end before it
+	return true;
+}
+
+/*!
+	Deletes the journal of \a waveletId, e.g. after all of its operations
+	have been acknowledged.
+*/
+void OperationJournal::remove(const QByteArray &waveletId)
+{
+	if (this->isEnabled())
+		QFile::remove(this->journalFileName(waveletId));
+}
+
+/*!
+	Returns the ids of all wavelets with a journal.
+*/
+QList<QByteArray> OperationJournal::waveletIds() const
+{
+	QList<QByteArray> ret;
+	if (!this->isEnabled())
+		return ret;
+	foreach (QString fileName, QDir(this->m_directory).entryList(QStringList() << "*.journal", QDir::Files))
+		ret.append(QByteArray::fromHex(fileName.left(fileName.length() - 8).toAscii()));
+	return ret;
+}
+
+QString OperationJournal::journalFileName(const QByteArray &waveletId) const
+{
+	return QDir(this->m_directory).filePath(QString::fromAscii(waveletId.toHex()) + ".journal");
+}
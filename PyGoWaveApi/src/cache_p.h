@@ -0,0 +1,127 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CACHE_P_H
+#define CACHE_P_H
+
+#include "pygowave_api_global.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QCache>
+#include <QtCore/QVariant>
+#include <QtCore/QString>
+
+namespace PyGoWave {
+
+	class ParticipantCache
+	{
+	public:
+		ParticipantCache();
+
+		QString fileName() const;
+		void setFileName(const QString &fileName);
+
+		bool load();
+		bool save();
+		bool isDirty() const;
+
+		bool contains(const QByteArray &id) const;
+		QList<QByteArray> ids() const;
+		QVariantMap data(const QByteArray &id) const;
+		bool isExpired(const QByteArray &id, int ttl) const;
+		void insert(const QByteArray &id, const QVariantMap &data);
+
+	private:
+		struct Entry
+		{
+			QVariantMap data;
+			uint fetched;
+		};
+
+		QString m_fileName;
+		QHash<QByteArray, Entry> m_entries;
+		bool m_dirty;
+
+		static const quint32 g_magic;
+		static const quint32 g_version;
+	};
+
+	class WaveCache
+	{
+	public:
+		WaveCache();
+
+		QString directory() const;
+		void setDirectory(const QString &directory);
+		bool isEnabled() const;
+
+		bool loadWaveList(QByteArray * viewerId, QVariantMap * waveList) const;
+		void saveWaveList(const QByteArray &viewerId, const QVariantMap &waveList);
+
+		bool loadSnapshot(const QByteArray &waveletId, int * version, QVariantMap * snapshot) const;
+		void saveSnapshot(const QByteArray &waveletId, int version, const QVariantMap &snapshot);
+		void removeSnapshot(const QByteArray &waveletId);
+
+		int memoryCapacity() const;
+		void setMemoryCapacity(int snapshots);
+
+	private:
+		struct Snapshot
+		{
+			int version;
+			QVariantMap data;
+		};
+
+		QString snapshotFileName(const QByteArray &waveletId) const;
+		static bool readFile(const QString &fileName, QVariantList * data);
+		static bool writeFile(const QString &fileName, const QVariantList &data);
+
+		QString m_directory;
+		mutable QCache<QByteArray, Snapshot> m_snapshots;
+
+		static const quint32 g_magic;
+		static const quint32 g_version;
+	};
+
+	class OperationJournal
+	{
+	public:
+		QString directory() const;
+		void setDirectory(const QString &directory);
+		bool isEnabled() const;
+
+		void append(const QByteArray &waveletId, int version, const QVariantList &pending, const QVariantList &cached, const QVariantMap &inflight);
+		bool load(const QByteArray &waveletId, int * version, QVariantList * pending, QVariantList * cached, QVariantMap * inflight) const;
+		void remove(const QByteArray &waveletId);
+		QList<QByteArray> waveletIds() const;
+
+	private:
+		QString journalFileName(const QByteArray &waveletId) const;
+
+		QString m_directory;
+
+		static const quint32 g_magic;
+		static const quint32 g_version;
+		static const qint64 g_compactSize;
+	};
+}
+
+#endif // CACHE_P_H
@@ -29,6 +29,8 @@
 #include <QtCore/QUuid>
 #include <QtCore/QRegExp>
 #include <QtCore/QTimer>
+#include <QtCore/QDir>
+#include <QtCore/QCryptographicHash>
 
 #include "controller_p.h"
 
@@ -48,27 +50,75 @@ Controller::Controller(QObject * parent) : QObject(parent), pd_ptr(new Controlle
 	d->jserializer = new QJson::Serializer();
 
 	d->conn = new QStompClient(this);
+	d->decoder = new FrameDecoder(this);
+	d->m_decodeThreshold = 4096;
 
 	d->pingTimer = new QTimer(this);
-	d->pingTimer->setInterval(20000);
+	d->pingTimer->setSingleShot(true);
 	d->pendingTimer = new QTimer(this);
 	d->pendingTimer->setInterval(10000);
+	d->cacheTimer = new QTimer(this);
+	d->cacheTimer->setInterval(5000);
+	d->cacheTimer->setSingleShot(true);
+	d->idleTimer = new QTimer(this);
+	d->inboundTimer = new QTimer(this);
+	d->inboundTimer->setSingleShot(true);
+	d->prefetchTimer = new QTimer(this);
+	d->prefetchTimer->setInterval(1000);
+	d->prefetchTimer->setSingleShot(true);
 
 	d->m_lastSearchId = 0;
+	d->m_serverSearchId = 0;
+	d->searchTimer = new QTimer(this);
+	d->searchTimer->setInterval(300);
+	d->searchTimer->setSingleShot(true);
+	d->metricsTimer = new QTimer(this);
+	d->metricsTimer->setInterval(1000);
+	d->metricsTimer->setSingleShot(true);
 	d->m_participantsTodoCollect = false;
 
+	d->m_compressionThreshold = 1024;
+	d->m_peerAcceptsDeflate = false;
+
+	d->m_keepAliveMinimum = 20000;
+	d->m_keepAliveMaximum = 120000;
+	d->m_keepAliveInterval = d->m_keepAliveMinimum;
+	d->m_keepAliveRoundTrip = Histogram(8);
+	d->m_lastSent = 0;
+
+	d->m_participantCacheTtl = 86400;
+	d->m_prefetchCount = 5;
+	d->m_idleUnsubscribeTimeout = 0;
+	d->m_updateInterval = 16;
+	d->m_updateLatencyCap = 100;
+	d->m_inboundSince = 0;
+	d->m_offlineEditing = false;
+	d->m_journalHeld = false;
+
+	d->m_recorder = NULL;
+	d->m_replay = false;
+	d->m_droppedFrames = 0;
+
 	connect(d->conn, SIGNAL(socketConnected()), this, SLOT(_q_conn_socketConnected()));
 	connect(d->conn, SIGNAL(socketDisconnected()), this, SLOT(_q_conn_socketDisconnected()));
 	connect(d->conn, SIGNAL(frameReceived()), this, SLOT(_q_conn_frameReceived()));
 	connect(d->conn, SIGNAL(socketStateChanged(QAbstractSocket::SocketState)), this, SLOT(_q_conn_socketStateChanged(QAbstractSocket::SocketState)));
 	connect(d->conn, SIGNAL(socketError(QAbstractSocket::SocketError)), this, SLOT(_q_conn_socketError(QAbstractSocket::SocketError)));
+	connect(d->decoder, SIGNAL(resultsReady()), this, SLOT(_q_decoder_resultsReady()));
 	connect(d->pingTimer, SIGNAL(timeout()), this, SLOT(_q_pingTimer_timeout()));
 	connect(d->pendingTimer, SIGNAL(timeout()), this, SLOT(_q_pendingTimer_timeout()));
+	connect(d->cacheTimer, SIGNAL(timeout()), this, SLOT(_q_cacheTimer_timeout()));
+	connect(d->prefetchTimer, SIGNAL(timeout()), this, SLOT(_q_prefetchTimer_timeout()));
+	connect(d->idleTimer, SIGNAL(timeout()), this, SLOT(_q_idleTimer_timeout()));
+	connect(d->inboundTimer, SIGNAL(timeout()), this, SLOT(_q_inboundTimer_timeout()));
+	connect(d->searchTimer, SIGNAL(timeout()), this, SLOT(_q_searchTimer_timeout()));
+	connect(d->metricsTimer, SIGNAL(timeout()), this, SLOT(_q_metricsTimer_timeout()));
 }
 
 Controller::~Controller()
 {
 	P_D(Controller);
+	d->saveCaches();
 	delete d->jparser;
 	delete d->jserializer;
 	foreach (QByteArray id, d->m_allParticipants.keys())
@@ -91,6 +141,9 @@ void Controller::reconnectToHost(const QString & username, const QString & passw
 	P_D(Controller);
 	d->m_username = username;
 	d->m_password = password;
+	d->loadCaches();
+	if (d->m_allWaves.isEmpty())
+		d->loadCachedWaves();
 	qDebug("Controller: Connecting to %s:%d...", qPrintable(d->m_stompServer), d->m_stompPort);
 	d->conn->connectToHost(d->m_stompServer, d->m_stompPort);
 }
@@ -99,7 +152,7 @@ void Controller::disconnectFromHost()
 {
 	P_D(Controller);
 	if (d->conn->socketState() == QAbstractSocket::ConnectedState) {
-		foreach (QByteArray id, d->m_openWavelets)
+		foreach (QByteArray id, d->m_openWavelets - d->m_dormantWavelets)
 			d->unsubscribeWavelet(id);
 		d->sendJson("manager", "DISCONNECT", QVariant());
 		d->conn->logout();
@@ -112,20 +165,129 @@ QString Controller::hostName() const
 	return d->m_stompServer;
 }
 
+int Controller::compressionThreshold() const
+{
+	const P_D(Controller);
+	return d->m_compressionThreshold;
+}
+
+void Controller::setCompressionThreshold(int bytes)
+{
+	P_D(Controller);
+	d->m_compressionThreshold = bytes; // 0 or less disables compression
+}
+
+int Controller::updateInterval() const
+{
+	const P_D(Controller);
+	return d->m_updateInterval;
+}
+
+void Controller::setUpdateInterval(int msecs)
+{
+	P_D(Controller);
+	d->m_updateInterval = msecs; // 0 applies every bundle right away
+	if (msecs <= 0)
+		d->flushInbound();
+}
+
+int Controller::keepAliveInterval() const
+{
+	const P_D(Controller);
+	return d->m_keepAliveInterval;
+}
+
+void Controller::setKeepAliveInterval(int minimum, int maximum)
+{
+	P_D(Controller);
+	d->m_keepAliveMinimum = qMax(minimum, 1000);
+	d->m_keepAliveMaximum = qMax(maximum, d->m_keepAliveMinimum); // Equal values disable the back-off
+	d->m_keepAliveInterval = qBound(d->m_keepAliveMinimum, d->m_keepAliveInterval, d->m_keepAliveMaximum);
+}
+
+FrameRecorder * Controller::frameRecorder() const
+{
+	const P_D(Controller);
+	return d->m_recorder;
+}
+
+void Controller::setFrameRecorder(FrameRecorder * recorder)
+{
+	P_D(Controller);
+	d->m_recorder = recorder;
+}
+
+QString Controller::cacheDirectory() const
+{
+	const P_D(Controller);
+	return d->m_cacheDirectory;
+}
+
+void Controller::setCacheDirectory(const QString &path)
+{
+	P_D(Controller);
+	if (d->m_cacheDirectory == path)
+		return;
+	d->saveCaches();
+	d->m_cacheDirectory = path;
+	d->loadCaches();
+}
+
+int Controller::participantCacheTtl() const
+{
+	const P_D(Controller);
+	return d->m_participantCacheTtl;
+}
+
+void Controller::setParticipantCacheTtl(int seconds)
+{
+	P_D(Controller);
+	d->m_participantCacheTtl = seconds;
+}
+
+int Controller::prefetchCount() const
+{
+	const P_D(Controller);
+	return d->m_prefetchCount;
+}
+
+void Controller::setPrefetchCount(int count)
+{
+	P_D(Controller);
+	d->m_prefetchCount = count; // 0 disables prefetching
+}
+
+bool Controller::offlineEditing() const
+{
+	const P_D(Controller);
+	return d->m_offlineEditing;
+}
+
+void Controller::setOfflineEditing(bool enabled)
+{
+	P_D(Controller);
+	d->m_offlineEditing = enabled; // Keep the waves on disconnect and journal edits until going online
+}
+
+ControllerMetrics Controller::metrics() const
+{
+	const P_D(Controller);
+	return d->m_metrics;
+}
+
+void Controller::resetMetrics()
+{
+	P_D(Controller);
+	d->m_metrics = ControllerMetrics();
+}
+
 void ControllerPrivate::addWave(WaveModel * wave, bool initial)
 {
 	P_Q(Controller);
 	Q_ASSERT(!this->m_allWaves.contains(wave->id()));
 	this->m_allWaves[wave->id()] = wave;
-	foreach (Wavelet * wavelet, wave->allWavelets()) {
-		this->m_allWavelets[wavelet->id()] = wavelet;
-		OpManager * mcached = new OpManager(wavelet->waveId(), wavelet->id(), this->m_viewerId, q);
-		q->connect(mcached, SIGNAL(afterOperationsInserted(int,int)), q, SLOT(_q_mcached_afterOperationsInserted(int,int)));
-		q->connect(wavelet, SIGNAL(participantsChanged()), q, SLOT(_q_wavelet_participantsChanged()));
-		this->mcached[wavelet->id()] = mcached;
-		this->mpending[wavelet->id()] = new OpManager(wavelet->waveId(), wavelet->id(), this->m_viewerId, q);
-		this->ispending[wavelet->id()] = false;
-	}
+	foreach (Wavelet * wavelet, wave->allWavelets())
+		this->addWavelet(wavelet);
 	bool created = false;
 	if (this->m_createdWaveId == wave->id()) {
 		this->m_createdWaveId.clear();
@@ -134,14 +296,45 @@ void ControllerPrivate::addWave(WaveModel * wave, bool initial)
 	emit q->waveAdded(wave->id(), created, initial);
 }
 
+void ControllerPrivate::addWavelet(Wavelet * wavelet)
+{
+	P_Q(Controller);
+	this->m_allWavelets[wavelet->id()] = wavelet;
+	OpManager * mcached = new OpManager(wavelet->waveId(), wavelet->id(), this->m_viewerId, q);
+	q->connect(mcached, SIGNAL(afterOperationsInserted(int,int)), q, SLOT(_q_mcached_afterOperationsInserted(int,int)));
+	q->connect(mcached, SIGNAL(operationChanged(int)), q, SLOT(_q_mcached_operationsChanged()));
+	q->connect(mcached, SIGNAL(afterOperationsRemoved(int,int)), q, SLOT(_q_mcached_operationsChanged()));
+	q->connect(wavelet, SIGNAL(participantsChanged()), q, SLOT(_q_wavelet_participantsChanged()));
+	this->mcached[wavelet->id()] = mcached;
+	this->mpending[wavelet->id()] = new OpManager(wavelet->waveId(), wavelet->id(), this->m_viewerId, q);
+	this->ispending[wavelet->id()] = false;
+}
+
 void ControllerPrivate::removeWave(const QByteArray &id, bool deleteObject)
 {
 	P_Q(Controller);
 	Q_ASSERT(this->m_allWaves.contains(id));
 	emit q->waveAboutToBeRemoved(id);
 	WaveModel * wave = this->m_allWaves.take(id);
-	foreach (Wavelet * wavelet, wave->allWavelets())
+	foreach (Wavelet * wavelet, wave->allWavelets()) {
 		this->m_allWavelets.remove(wavelet->id());
+		this->m_openWavelets.remove(wavelet->id());
+		this->m_deferredOpens.remove(wavelet->id());
+		this->m_dormantWavelets.remove(wavelet->id());
+		this->m_lastViewed.remove(wavelet->id());
+		this->m_inbound.remove(wavelet->id());
+		delete this->mcached.take(wavelet->id());
+		delete this->mpending.take(wavelet->id());
+		this->ispending.remove(wavelet->id());
+		this->m_journalDirty.remove(wavelet->id());
+		this->m_journalBase.remove(wavelet->id());
+		this->m_inflight.remove(wavelet->id());
+		this->m_inflightCheck.remove(wavelet->id());
+		this->m_resync.remove(wavelet->id());
+		this->m_resyncSnapshot.remove(wavelet->id());
+		this->m_routes.remove(this->m_waveAccessKeyRx + "." + wavelet->id() + ".waveop");
+		this->m_metrics.waveletAckLatency.remove(wavelet->id());
+	}
 	if (deleteObject)
 		wave->deleteLater();
 }
@@ -165,99 +358,170 @@ void ControllerPrivate::_q_conn_socketDisconnected()
 {
 	P_Q(Controller);
 	qDebug("Controller: Disconnected...");
+	this->flushInbound();
 	this->pingTimer->stop();
 	this->m_state = Controller::ClientDisconnected;
-	this->clearWaves(true);
+	this->m_routes.clear();
+	this->saveCaches();
+	this->prefetchTimer->stop();
+	this->m_prefetchQueue.clear();
+	this->m_prefetching.clear();
+	this->m_resync.clear();
+	this->m_resyncSnapshot.clear();
+	this->m_inflightCheck.clear();
+	if (this->m_offlineEditing) {
+		// Keep editing; a bundle without ACK is sent again when going online,
+		// unless the snapshot shows that it has been applied
+		this->pendingTimer->stop();
+		this->m_bundleSentAt.clear();
+		foreach (QByteArray id, this->ispending.keys())
+			this->ispending[id] = false;
+	}
+	else
+		this->clearWaves(true);
 	emit q->stateChanged(Controller::ClientDisconnected);
 }
 
 void ControllerPrivate::_q_conn_frameReceived()
+{
+	foreach (QStompResponseFrame frame, this->conn->fetchAllFrames())
+		this->processFrame(frame);
+}
+
+void ControllerPrivate::processFrame(const QStompResponseFrame &frame)
 {
 	P_Q(Controller);
-	foreach (QStompResponseFrame frame, this->conn->fetchAllFrames()) {
-		if (this->m_state == Controller::ClientConnected) {
-			if (frame.type() == QStompResponseFrame::ResponseConnected) {
-				qDebug("Controller: Authenticating...");
-				this->m_waveAccessKeyRx = QUuid::createUuid().toString().replace(QRegExp("\\{|\\}"), "").toAscii();
-				this->m_waveAccessKeyTx = this->m_waveAccessKeyRx;
-
-				this->subscribeWavelet("login", false);
-
-				QVariantMap prop;
-				prop["username"] = this->m_username;
-				prop["password"] = this->m_password;
-				this->m_password.clear(); // Delete Password after use
-				this->sendJson("login", "LOGIN", prop);
+	this->m_metrics.bytesIn += frame.rawBody().size();
+	if (this->m_recorder)
+		this->m_recorder->recordFrame(FrameRecorder::Inbound, frame.type(), frame.destination(), frame.headerValue("content-encoding"), frame.rawBody());
+	if (this->m_state == Controller::ClientConnected) {
+		if (frame.type() == QStompResponseFrame::ResponseConnected) {
+			qDebug("Controller: Authenticating...");
+			this->m_waveAccessKeyRx = QUuid::createUuid().toString().replace(QRegExp("\\{|\\}"), "").toAscii();
+			this->m_waveAccessKeyTx = this->m_waveAccessKeyRx;
+
+			this->subscribeWavelet("login", false);
+
+			QVariantMap prop;
+			prop["username"] = this->m_username;
+			prop["password"] = this->m_password;
+			prop["accept_encoding"] = QVariantList() << QString("deflate");
+			this->m_password.clear(); // Delete Password after use
+			this->sendJson("login", "LOGIN", prop);
+		}
+		else if (frame.type() == QStompResponseFrame::ResponseMessage) {
+			bool ok = false;
+			QVariantList msgs = this->parseFrameBody(frame, &ok).toList();
+			if (!ok) {
+				qWarning("Controller: Error in parsing received JSON data!"); return;
+			}
+			if (msgs.size() != 1) {
+				qWarning("Controller: Login reply must contain a single message!"); return;
 			}
-			else if (frame.type() == QStompResponseFrame::ResponseMessage) {
-				bool ok = false;
-				QVariantList msgs = this->jparser->parse(frame.rawBody(), &ok).toList();
-				if (!ok) {
-					qWarning("Controller: Error in parsing received JSON data!"); continue;
+			QVariantMap msg = msgs.at(0).toMap();
+			if (msg.contains("type") && msg.contains("property")) {
+				QString type = msg["type"].toString();
+				if (type == "ERROR") {
+					QVariantMap prop = msg["property"].toMap();
+					emit q->errorOccurred("login", prop["tag"].toString(), prop["desc"].toString());
+					return;
 				}
-				if (msgs.size() != 1) {
-					qWarning("Controller: Login reply must contain a single message!"); continue;
+				if (type != "LOGIN") {
+					qWarning("Controller: Login reply must be a 'LOGIN' message!"); return;
 				}
-				QVariantMap msg = msgs.at(0).toMap();
-				if (msg.contains("type") && msg.contains("property")) {
-					QString type = msg["type"].toString();
-					if (type == "ERROR") {
-						QVariantMap prop = msg["property"].toMap();
-						emit q->errorOccurred("login", prop["tag"].toString(), prop["desc"].toString());
-						continue;
-					}
-					if (type != "LOGIN") {
-						qWarning("Controller: Login reply must be a 'LOGIN' message!"); continue;
-					}
-					QVariantMap prop = msg["property"].toMap();
-					if (prop.contains("rx_key") && prop.contains("tx_key") && prop.contains("viewer_id")) {
-						this->unsubscribeWavelet("login", false);
-						this->m_waveAccessKeyRx = prop["rx_key"].toByteArray();
-						this->m_waveAccessKeyTx = prop["tx_key"].toByteArray();
-						this->m_viewerId = prop["viewer_id"].toByteArray();
-						this->subscribeWavelet("manager", false);
-						this->pingTimer->start();
-						this->m_state = Controller::ClientOnline;
-						qDebug("Controller: Online! Keys: %s/rx %s/tx", this->m_waveAccessKeyRx.constData(), this->m_waveAccessKeyTx.constData());
-						emit q->stateChanged(Controller::ClientOnline);
-
-						this->sendJson("manager", "WAVE_LIST");
+				QVariantMap prop = msg["property"].toMap();
+				if (prop.contains("rx_key") && prop.contains("tx_key") && prop.contains("viewer_id")) {
+					this->unsubscribeWavelet("login", false);
+					this->m_waveAccessKeyRx = prop["rx_key"].toByteArray();
+					this->m_waveAccessKeyTx = prop["tx_key"].toByteArray();
+					if (this->m_viewerId != prop["viewer_id"].toByteArray())
+						this->clearWaves(true); // Cached waves of someone else
+					this->m_viewerId = prop["viewer_id"].toByteArray();
+					this->m_peerAcceptsDeflate = prop["content_encoding"].toStringList().contains("deflate");
+					this->subscribeWavelet("manager", false);
+					if (!this->m_replay) {
+						this->m_keepAliveInterval = this->m_keepAliveMinimum;
+						this->m_keepAliveRoundTrip.clear(); // Possibly another route
+						this->pingTimer->start(this->m_keepAliveInterval);
 					}
-					else {
-						qWarning("Controller: Login reply must contain the properties 'rx_key', 'tx_key' and 'viewer_id'!"); continue;
+					this->m_state = Controller::ClientOnline;
+					qDebug("Controller: Online! Keys: %s/rx %s/tx", this->m_waveAccessKeyRx.constData(), this->m_waveAccessKeyTx.constData());
+					emit q->stateChanged(Controller::ClientOnline);
+
+					// Send edits made while offline first, then open the wavelets
+					QSet<QByteArray> openWavelets = this->m_openWavelets + this->m_deferredOpens;
+					this->m_deferredOpens.clear();
+					foreach (QByteArray id, this->m_allWavelets.keys()) {
+						if (this->hasUnsentOperations(id))
+							this->resyncWavelet(id, openWavelets.contains(id));
+						else if (openWavelets.contains(id) && !this->m_dormantWavelets.contains(id))
+							this->subscribeWavelet(id);
 					}
+
+					this->sendJson("manager", "WAVE_LIST");
+					this->retrieveParticipants();
 				}
 				else {
-					qWarning("Controller: Message lacks 'type' and 'property' field!"); continue;
+					qWarning("Controller: Login reply must contain the properties 'rx_key', 'tx_key' and 'viewer_id'!"); return;
 				}
 			}
-		}
-		else if (this->m_state == Controller::ClientOnline && frame.type() == QStompResponseFrame::ResponseMessage) {
-			///qDebug("Controller: Received on %s:\n%s", frame.destination().constData(), qPrintable(frame.body()));
-			bool ok = false;
-			QList<QByteArray> routing_key = frame.destination().split('.');
-			if (routing_key.size() != 3 || routing_key[2] != "waveop") {
-				qWarning("Controller: Malformed routing key '%s'!", frame.destination().constData()); continue;
-			}
-			QByteArray waveletId = routing_key[1];
-			QVariantList msgs = this->jparser->parse(frame.rawBody(), &ok).toList();
-			if (!ok) {
-				qWarning("Controller: Error in parsing received JSON data!"); continue;
-			}
-			foreach (QVariant vmsg, msgs) {
-				QVariantMap msg = vmsg.toMap();
-				if (msg.contains("type")) {
-					if (msg.contains("property"))
-						this->processMessage(waveletId, msg["type"].toString(), msg["property"]);
-					else
-						this->processMessage(waveletId, msg["type"].toString());
-				}
-				else {
-					qWarning("Controller: Message lacks 'type' field!"); continue;
-				}
+			else {
+				qWarning("Controller: Message lacks 'type' and 'property' field!"); return;
 			}
 		}
 	}
+	else if (this->m_state == Controller::ClientOnline && frame.type() == QStompResponseFrame::ResponseMessage) {
+		///qDebug("Controller: Received on %s:\n%s", frame.destination().constData(), qPrintable(frame.body()));
+		// Large frames are decoded in the background and later ones of the same wavelet
+		// wait for them; other wavelets go on. Manager messages may add or remove
+		// wavelets, so they keep their place among the frames of all destinations.
+		QHash<QByteArray,Route>::const_iterator route = this->m_routes.constFind(frame.destination());
+		bool barrier = route != this->m_routes.constEnd() && route.value().kind == Route::ManagerRoute;
+		if (!this->m_replay && (frame.rawBody().size() >= this->m_decodeThreshold || this->decoder->isBusy(frame.destination(), barrier))) {
+			this->decoder->enqueue(frame.destination(), frame.rawBody(), frame.headerValue("content-encoding") == "deflate", barrier);
+			return;
+		}
+		bool ok = false;
+		QVariant data = this->parseFrameBody(frame, &ok);
+		this->processMessages(frame.destination(), data, ok);
+	}
+}
+
+void ControllerPrivate::_q_decoder_resultsReady()
+{
+	foreach (FrameDecoder::Result result, this->decoder->takeResults()) {
+		this->m_metrics.jsonParseTime.addSample(result.parseTime);
+		if (this->m_state == Controller::ClientOnline)
+			this->processMessages(result.destination, result.data, result.ok);
+	}
+}
+
+void ControllerPrivate::processMessages(const QByteArray &destination, const QVariant &data, bool ok)
+{
+	QHash<QByteArray,Route>::const_iterator route = this->m_routes.constFind(destination);
+	if (route == this->m_routes.constEnd() && this->m_replay && this->routeReplayedWavelet(destination))
+		route = this->m_routes.constFind(destination);
+	if (route == this->m_routes.constEnd()) {
+		this->m_droppedFrames++;
+		qWarning("Controller: Unknown routing key '%s'!", destination.constData()); return;
+	}
+	if (!ok) {
+		this->m_droppedFrames++;
+		qWarning("Controller: Error in parsing received JSON data!"); return;
+	}
+	Route target = route.value(); // Handlers may change the routes
+	foreach (QVariant vmsg, data.toList()) {
+		QVariantMap msg = vmsg.toMap();
+		if (msg.contains("type")) {
+			if (msg.contains("property"))
+				this->processMessage(target, msg["type"].toString(), msg["property"]);
+			else
+				this->processMessage(target, msg["type"].toString());
+		}
+		else {
+			qWarning("Controller: Message lacks 'type' field!"); continue;
+		}
+	}
 }
 
 void ControllerPrivate::_q_conn_socketStateChanged(QAbstractSocket::SocketState state)
@@ -311,30 +575,165 @@ Participant * Controller::participant(const QByteArray &id)
 {
 	P_D(Controller);
 	if (!d->m_allParticipants.contains(id)) {
-		d->m_allParticipants.insert(id, new Participant(id));
-		if (d->m_participantsTodoCollect)
-			d->m_participantsTodo.insert(id);
-		else
-			d->retrieveParticipant(id);
+		Participant * p = new Participant(id);
+		d->m_allParticipants.insert(id, p);
+		if (d->m_participantCache.contains(id)) {
+			// Use the cached data right away, revalidate later if it is too old
+			p->updateData(d->m_participantCache.data(id), d->m_stompServer);
+			if (d->m_participantCache.isExpired(id, d->m_participantCacheTtl)) {
+				d->m_participantsStale.insert(id);
+				if (!d->cacheTimer->isActive())
+					d->cacheTimer->start();
+			}
+		}
+		else {
+			d->m_participantIndex.insert(id, QString()); // Found by its id until the data arrives
+			if (d->m_participantsTodoCollect)
+				d->m_participantsTodo.insert(id);
+			else
+				d->retrieveParticipant(id);
+		}
 	}
 	return d->m_allParticipants[id];
 }
 
 void Controller::openWavelet(const QByteArray &waveletId)
+{
+	this->openWavelets(QList<QByteArray>() << waveletId);
+}
+
+void Controller::openWavelets(const QList<QByteArray> &waveletIds)
 {
 	P_D(Controller);
-	d->subscribeWavelet(waveletId);
+	QList<QByteArray> subscribe;
+	foreach (QByteArray waveletId, waveletIds) {
+		if (!d->m_allWavelets.contains(waveletId))
+			continue;
+		if (d->m_prefetching == waveletId) {
+			// Already subscribed, the snapshot is on its way
+			d->m_prefetching.clear();
+			d->prefetchTimer->start();
+		}
+		else if (d->m_dormantWavelets.contains(waveletId)) {
+			this->markWaveletViewed(waveletId);
+			continue;
+		}
+		else
+			subscribe.append(waveletId);
+		d->showCachedSnapshot(waveletId);
+		d->m_lastViewed[waveletId] = monotonicMicroseconds();
+	}
+	// Send all requests at once, the snapshots arrive as they are ready
+	foreach (QByteArray waveletId, subscribe) {
+		if (d->m_state == Controller::ClientOnline)
+			d->subscribeWavelet(waveletId);
+		else
+			d->m_deferredOpens.insert(waveletId); // Subscribed when going online
+	}
+}
+
+void ControllerPrivate::showCachedSnapshot(const QByteArray &waveletId)
+{
+	// Show the cached snapshot right away; the server sends what changed since
+	if (this->m_openWavelets.contains(waveletId))
+		return;
+	Wavelet * wavelet = this->m_allWavelets[waveletId];
+	int version = 0;
+	QVariantMap snapshot;
+	if (this->m_waveCache.loadSnapshot(waveletId, &version, &snapshot)) {
+		this->m_cachedVersions[waveletId] = version;
+		this->handleWaveletOpen(wavelet, snapshot);
+		// Hold back edits until the server confirmed or replaced the snapshot
+		this->m_resyncSnapshot.insert(waveletId);
+	}
+	else
+		this->m_cachedVersions.remove(waveletId);
+	if (this->m_journalBase.contains(waveletId)) {
+		// Show the edits restored from the journal on top of the snapshot
+		int base = this->m_journalBase.take(waveletId);
+		if (wavelet->version() == base) {
+			wavelet->beginChanges();
+			wavelet->applyOperations(this->mpending[waveletId]->operations(), QDateTime::currentDateTime(), this->m_viewerId);
+			wavelet->applyOperations(this->mcached[waveletId]->operations(), QDateTime::currentDateTime(), this->m_viewerId);
+			wavelet->endChanges();
+		}
+		wavelet->setVersion(base);
+	}
 }
 
 void Controller::closeWavelet(const QByteArray &waveletId)
 {
 	P_D(Controller);
-	d->unsubscribeWavelet(waveletId);
+	if (!d->m_dormantWavelets.remove(waveletId) && !d->m_deferredOpens.remove(waveletId))
+		d->unsubscribeWavelet(waveletId);
+	d->m_openWavelets.remove(waveletId);
+	d->m_lastViewed.remove(waveletId);
+}
+
+void Controller::markWaveletViewed(const QByteArray &waveletId)
+{
+	P_D(Controller);
+	if (!d->m_openWavelets.contains(waveletId))
+		return;
+	d->m_lastViewed[waveletId] = monotonicMicroseconds();
+	if (d->m_dormantWavelets.contains(waveletId) && d->m_state == Controller::ClientOnline && !d->m_routes.contains(d->m_waveAccessKeyRx + "." + waveletId + ".waveop")) {
+		// Catch up from the version shown; hold back edits until then
+		d->m_resyncSnapshot.insert(waveletId);
+		d->subscribeWavelet(waveletId);
+	}
+}
+
+int Controller::idleUnsubscribeTimeout() const
+{
+	const P_D(Controller);
+	return d->m_idleUnsubscribeTimeout;
+}
+
+void Controller::setIdleUnsubscribeTimeout(int seconds)
+{
+	P_D(Controller);
+	d->m_idleUnsubscribeTimeout = seconds; // 0 disables
+	if (seconds > 0)
+		d->idleTimer->start(qBound(10, seconds / 4, 60) * 1000);
+	else
+		d->idleTimer->stop();
+}
+
+void ControllerPrivate::_q_idleTimer_timeout()
+{
+	// Wavelets nobody looked at for a while do not need live updates
+	if (this->m_state != Controller::ClientOnline)
+		return;
+	quint64 now = monotonicMicroseconds();
+	quint64 timeout = this->m_idleUnsubscribeTimeout * 1000000llu;
+	foreach (QByteArray id, this->m_openWavelets - this->m_dormantWavelets) {
+		if (now - this->m_lastViewed.value(id, now) < timeout)
+			continue;
+		if (this->hasPendingOperations(id) || this->hasUnsentOperations(id) || this->m_resync.contains(id) || this->m_resyncSnapshot.contains(id))
+			continue;
+		this->unsubscribeWavelet(id);
+		this->m_dormantWavelets.insert(id);
+	}
 }
 
 void ControllerPrivate::_q_pingTimer_timeout()
 {
+	// Anything sent keeps the connection alive; only ping if nothing was
+	int idle = (int) ((monotonicMicroseconds() - this->m_lastSent) / 1000);
+	if (idle < this->m_keepAliveInterval) {
+		this->pingTimer->start(this->m_keepAliveInterval - idle);
+		return;
+	}
 	this->sendJson("manager", "PING", QString::number(this->timestamp()));
+
+	// Back off while idle, come closer again if the round trip time fluctuates;
+	// only recent pings count, old ones would hide a change of the network
+	const Histogram &rtt = this->m_keepAliveRoundTrip;
+	if (rtt.count() >= 4 && rtt.standardDeviation() > rtt.mean() / 2)
+		this->m_keepAliveInterval = qMax(this->m_keepAliveInterval / 2, this->m_keepAliveMinimum);
+	else
+		this->m_keepAliveInterval = qMin(this->m_keepAliveInterval * 2, this->m_keepAliveMaximum);
+	this->pingTimer->start(this->m_keepAliveInterval);
 }
 
 quint64 ControllerPrivate::timestamp()
@@ -357,28 +756,127 @@ void ControllerPrivate::sendJson(const QByteArray & dest, const QString &type, c
 	frame.setDestination(this->m_waveAccessKeyTx + "." + dest + ".clientop");
 	frame.setHeaderValue("exchange", "wavelet.topic");
 	frame.setHeaderValue("content-type", "application/json");
-	frame.setRawBody(this->jserializer->serialize(obj));
+	QByteArray body = this->jserializer->serialize(obj);
+	if (this->m_peerAcceptsDeflate && this->m_compressionThreshold > 0 && body.size() >= this->m_compressionThreshold) {
+		QByteArray compressed = ControllerPrivate::deflate(body);
+		if (compressed.size() < body.size()) {
+			frame.setHeaderValue("content-encoding", "deflate");
+			body = compressed;
+		}
+	}
+	frame.setHeaderValue("content-length", QByteArray::number(body.size()));
+	frame.setRawBody(body);
+	this->m_metrics.bytesOut += body.size();
+	if (this->m_recorder) // Never write the login credentials to disk
+		this->m_recorder->recordFrame(FrameRecorder::Outbound, frame.type(), frame.destination(), frame.headerValue("content-encoding"), dest == "login" ? QByteArray() : body);
+	if (this->m_replay)
+		return; // Nowhere to send to
 	///if (dest != "login") qDebug("Controller: Sending to %s:\n%s", frame.destination().constData(), qPrintable(frame.body()));
 	this->conn->sendFrame(frame);
-	if (this->m_state == Controller::ClientOnline) {
-		this->pingTimer->stop();
-		this->pingTimer->start();
-	}
+	this->m_lastSent = monotonicMicroseconds();
+	if (type != "PING")
+		this->m_keepAliveInterval = this->m_keepAliveMinimum; // Active again
+}
+
+QVariant ControllerPrivate::parseFrameBody(const QStompResponseFrame &frame, bool * ok)
+{
+	FrameDecoder::Frame encoded;
+	encoded.destination = frame.destination();
+	encoded.body = frame.rawBody();
+	encoded.deflated = frame.headerValue("content-encoding") == "deflate";
+	FrameDecoder::Result result = FrameDecoder::decode(encoded, this->jparser);
+	if (result.parseTime != 0)
+		this->m_metrics.jsonParseTime.addSample(result.parseTime);
+	*ok = result.ok;
+	return result.data;
+}
+
+QByteArray ControllerPrivate::deflate(const QByteArray &data)
+{
+	// qCompress prepends the uncompressed size as 4 byte big endian integer
+	return qCompress(data).mid(4);
+}
+
+QByteArray ControllerPrivate::inflate(const QByteArray &data)
+{
+	// qUncompress needs a size hint; it grows its buffer if the hint is too small
+	QByteArray input;
+	quint32 hint = (quint32) data.size() * 4;
+	input.append((char) ((hint >> 24) & 0xff));
+	input.append((char) ((hint >> 16) & 0xff));
+	input.append((char) ((hint >> 8) & 0xff));
+	input.append((char) (hint & 0xff));
+	input.append(data);
+	return qUncompress(input);
+}
+
+void ControllerPrivate::beginReplay()
+{
+	P_Q(Controller);
+	// Act like a connected client which has not logged in yet; no frames
+	// are sent to the message broker from now on
+	this->m_replay = true;
+	this->pingTimer->stop();
+	this->inboundTimer->stop();
+	this->m_inbound.clear();
+	this->m_routes.clear();
+	this->clearWaves(true);
+	this->m_state = Controller::ClientConnected;
+	emit q->stateChanged(Controller::ClientConnected);
+}
+
+/*!
+	\internal
+	Sets up the route of a wavelet on its first replayed frame. The recorded
+	WAVELET_OPEN of the client is never sent while replaying, so nothing else
+	subscribes the wavelet. Returns false if \a destination does not belong to
+	a known wavelet.
+*/
+bool ControllerPrivate::routeReplayedWavelet(const QByteArray &destination)
+{
+	QByteArray prefix = this->m_waveAccessKeyRx + ".";
+	if (!destination.startsWith(prefix) || !destination.endsWith(".waveop"))
+		return false;
+	QByteArray id = destination.mid(prefix.size(), destination.size() - prefix.size() - 7);
+	if (!this->m_allWavelets.contains(id))
+		return false;
+	this->subscribeWavelet(id, false);
+	return true;
 }
 
 void ControllerPrivate::subscribeWavelet(const QByteArray &id, bool open)
 {
-	this->conn->subscribe(
-			this->m_waveAccessKeyRx + "." + id + ".waveop",
+	QByteArray destination = this->m_waveAccessKeyRx + "." + id + ".waveop";
+	Route route;
+	route.id = id;
+	if (id == "login")
+		route.kind = Route::LoginRoute;
+	else if (id == "manager")
+		route.kind = Route::ManagerRoute;
+	else {
+		route.kind = Route::WaveletRoute;
+		route.wavelet = this->m_allWavelets.value(id);
+	}
+	this->m_routes.insert(destination, route);
+
+	if (!this->m_replay)
+		this->conn->subscribe(
+			destination,
 			true,
 			QStompHeaderList()
-			<< QPair<QByteArray,QByteArray>("routing_key", this->m_waveAccessKeyRx + "." + id + ".waveop")
+			<< QPair<QByteArray,QByteArray>("routing_key", destination)
 			<< QPair<QByteArray,QByteArray>("exchange", "wavelet.direct")
 			<< QPair<QByteArray,QByteArray>("exclusive", "true")
 	);
 
-	if (open)
-		this->sendJson(id, "WAVELET_OPEN", QVariant());
+	if (open) {
+		QVariantMap prop;
+		if (this->m_dormantWavelets.contains(id))
+			prop["version"] = route.wavelet->version(); // The model is still loaded
+		else if (this->m_cachedVersions.contains(id))
+			prop["version"] = this->m_cachedVersions[id];
+		this->sendJson(id, "WAVELET_OPEN", prop);
+	}
 }
 
 void ControllerPrivate::unsubscribeWavelet(const QByteArray &id, bool close)
@@ -386,14 +884,17 @@ void ControllerPrivate::unsubscribeWavelet(const QByteArray &id, bool close)
 	if (close)
 		this->sendJson(id, "WAVELET_CLOSE", QVariant());
 
-	this->conn->unsubscribe(
-			this->m_waveAccessKeyRx + "." + id + ".waveop",
+	QByteArray destination = this->m_waveAccessKeyRx + "." + id + ".waveop";
+	this->m_routes.remove(destination);
+	this->m_metrics.waveletAckLatency.remove(id);
+
+	if (!this->m_replay)
+		this->conn->unsubscribe(
+			destination,
 			QStompHeaderList()
-			<< QPair<QByteArray,QByteArray>("routing_key", this->m_waveAccessKeyRx + "." + id + ".waveop")
+			<< QPair<QByteArray,QByteArray>("routing_key", destination)
 			<< QPair<QByteArray,QByteArray>("exchange", "wavelet.direct")
 	);
-	if (this->m_openWavelets.contains(id))
-		this->m_openWavelets.remove(id);
 }
 
 void Controller::addParticipant(const QByteArray &waveletId, const QByteArray &id)
@@ -481,6 +982,93 @@ void ControllerPrivate::updateWaveletByDict(Wavelet * wavelet, const QVariantMap
 		wavelet->removeParticipant(id);
 }
 
+void ControllerPrivate::updateWave(const QByteArray &waveId, const QVariantMap &wavelets, bool initial)
+{
+	P_Q(Controller);
+	if (!this->m_allWaves.contains(waveId)) { // New wave
+		WaveModel * wave = new WaveModel(waveId, this->m_viewerId, q);
+		foreach (QString s_waveletId, wavelets.keys())
+			this->newWaveletByDict(wave, s_waveletId.toAscii(), wavelets[s_waveletId].toMap());
+		this->addWave(wave, initial);
+	}
+	else { // Update old
+		WaveModel * wave = this->m_allWaves[waveId];
+		foreach (QString s_waveletId, wavelets.keys()) {
+			QByteArray waveletId = s_waveletId.toAscii();
+			Wavelet * wavelet = wave->wavelet(waveletId);
+			if (wavelet)
+				this->updateWaveletByDict(wavelet, wavelets[s_waveletId].toMap());
+			else
+				this->addWavelet(this->newWaveletByDict(wave, waveletId, wavelets[s_waveletId].toMap()));
+		}
+	}
+}
+
+void ControllerPrivate::loadCachedWaves()
+{
+	QByteArray viewerId;
+	QVariantMap waveList;
+	if (!this->m_waveCache.loadWaveList(&viewerId, &waveList))
+		return;
+	this->m_viewerId = viewerId;
+	this->collectParticipants();
+	foreach (QString s_waveId, waveList.keys())
+		this->updateWave(s_waveId.toAscii(), waveList[s_waveId].toMap(), true);
+	this->retrieveParticipants();
+	this->restoreJournal();
+}
+
+void ControllerPrivate::schedulePrefetch(const QVariantMap &waveList)
+{
+	// Warm the snapshot cache with the most recently modified wavelets
+	QMap< uint, QPair<QByteArray,int> > byModification;
+	foreach (QVariant wave, waveList) {
+		QVariantMap wavelets = wave.toMap();
+		foreach (QString s_waveletId, wavelets.keys()) {
+			QVariantMap waveletDict = wavelets[s_waveletId].toMap();
+			byModification.insertMulti(
+					waveletDict["lastModifiedTime"].toUInt(),
+					qMakePair(s_waveletId.toAscii(), waveletDict["version"].toInt())
+				);
+		}
+	}
+	this->m_prefetchQueue.clear();
+	QMapIterator< uint, QPair<QByteArray,int> > it(byModification);
+	it.toBack();
+	while (it.hasPrevious() && this->m_prefetchQueue.size() < this->m_prefetchCount)
+		this->m_prefetchQueue.append(it.previous().value());
+	if (!this->m_prefetchQueue.isEmpty() && this->m_prefetching.isEmpty())
+		this->prefetchTimer->start();
+}
+
+void ControllerPrivate::_q_prefetchTimer_timeout()
+{
+	if (this->m_state != Controller::ClientOnline || !this->m_prefetching.isEmpty())
+		return;
+	if (this->pendingTimer->isActive()) {
+		this->prefetchTimer->start(); // Own operations are in flight, wait
+		return;
+	}
+	while (!this->m_prefetchQueue.isEmpty()) {
+		QPair<QByteArray,int> next = this->m_prefetchQueue.takeFirst();
+		QByteArray id = next.first;
+		if (!this->m_allWavelets.contains(id) || this->m_openWavelets.contains(id) || this->m_deferredOpens.contains(id) || this->m_resync.contains(id))
+			continue;
+		int version = 0;
+		QVariantMap snapshot;
+		if (this->m_waveCache.loadSnapshot(id, &version, &snapshot)) {
+			if (version == next.second)
+				continue; // Up to date and in memory now
+			this->m_cachedVersions[id] = version;
+		}
+		else
+			this->m_cachedVersions.remove(id);
+		this->m_prefetching = id;
+		this->subscribeWavelet(id);
+		return;
+	}
+}
+
 void ControllerPrivate::collectParticipants()
 {
 	this->m_participantsTodoCollect = true;
@@ -489,7 +1077,7 @@ void ControllerPrivate::collectParticipants()
 void ControllerPrivate::retrieveParticipants()
 {
 	// Retrieve missing participants
-	if (this->m_participantsTodo.size() > 0) {
+	if (this->m_participantsTodo.size() > 0 && this->m_state == Controller::ClientOnline) {
 		QVariantList l;
 		foreach (QByteArray id, this->m_participantsTodo)
 			l << QString::fromAscii(id);
@@ -501,181 +1089,306 @@ void ControllerPrivate::retrieveParticipants()
 
 void ControllerPrivate::retrieveParticipant(const QByteArray & id)
 {
+	if (this->m_state != Controller::ClientOnline) {
+		this->m_participantsTodo.insert(id); // Retrieved when going online
+		return;
+	}
 	this->sendJson("manager", "PARTICIPANT_INFO", QVariantList() << QString::fromAscii(id));
 }
 
-void ControllerPrivate::processMessage(const QByteArray &waveletId, const QString &type, const QVariant &property)
+void ControllerPrivate::processMessage(const Route &route, const QString &type, const QVariant &property)
 {
 	P_Q(Controller);
 	if (type == "ERROR") {
 		QVariantMap propertyMap = property.toMap();
-		emit q->errorOccurred(waveletId, propertyMap["tag"].toString(), propertyMap["desc"].toString());
+		if (route.id == this->m_prefetching) { // Nobody is waiting for it
+			this->m_prefetching.clear();
+			this->unsubscribeWavelet(route.id, false);
+			this->prefetchTimer->start();
+			return;
+		}
+		emit q->errorOccurred(route.id, propertyMap["tag"].toString(), propertyMap["desc"].toString());
 		return;
 	}
-	// Manager messages
-	if (waveletId == "manager") {
-		if (type == "WAVE_LIST") {
-			this->clearWaves(true); // Clear all; this message is only received once per connection
-			QVariantMap propertyMap = property.toMap();
-			this->collectParticipants();
-			foreach (QString s_waveId, propertyMap.keys()) {
-				QByteArray waveId = s_waveId.toAscii();
-				WaveModel * wave = new WaveModel(waveId, this->m_viewerId, q);
-				QVariantMap wavelets = propertyMap[s_waveId].toMap();
-				foreach (QString s_waveletId, wavelets.keys())
-					this->newWaveletByDict(wave, s_waveletId.toAscii(), wavelets[s_waveletId].toMap());
-				this->addWave(wave, true);
-			}
-			this->retrieveParticipants();
-		}
-		else if (type == "WAVELET_LIST") {
-			QVariantMap propertyMap = property.toMap();
-			QByteArray waveId = propertyMap["waveId"].toByteArray();
-			if (!this->m_allWaves.contains(waveId)) { // New wave
-				WaveModel * wave = new WaveModel(waveId, this->m_viewerId, q);
-				QVariantMap wavelets = propertyMap["wavelets"].toMap();
-				this->collectParticipants();
-				foreach (QString s_waveletId, wavelets.keys())
-					this->newWaveletByDict(wave, s_waveletId.toAscii(), wavelets[s_waveletId].toMap());
-				this->addWave(wave, false);
-				this->retrieveParticipants();
-			}
-			else { // Update old
-				WaveModel * wave = this->m_allWaves[waveId];
-				QVariantMap wavelets = propertyMap["wavelets"].toMap();
-				foreach (QString s_waveletId, wavelets.keys()) {
-					QByteArray waveletId = s_waveletId.toAscii();
-					Wavelet * wavelet = wave->wavelet(waveletId);
-					this->collectParticipants();
-					if (wavelet)
-						this->updateWaveletByDict(wavelet, wavelets[s_waveletId].toMap());
-					else
-						this->newWaveletByDict(wave, waveletId, wavelets[s_waveletId].toMap());
-					this->retrieveParticipants();
-				}
-			}
+	if (route.kind == Route::ManagerRoute) {
+		ManagerHandler handler = ControllerPrivate::managerHandlers().value(type);
+		if (handler)
+			(this->*handler)(property);
+	}
+	else if (route.kind == Route::WaveletRoute) {
+		if (route.wavelet.isNull()) // Removed while its messages were queued
+			return;
+		WaveletHandler handler = ControllerPrivate::waveletHandlers().value(type);
+		if (handler)
+			(this->*handler)(route.wavelet, property);
+	}
+}
+
+static QHash<QString, ControllerPrivate::ManagerHandler> createManagerHandlers()
+{
+	QHash<QString, ControllerPrivate::ManagerHandler> handlers;
+	handlers["WAVE_LIST"] = &ControllerPrivate::handleWaveList;
+	handlers["WAVELET_LIST"] = &ControllerPrivate::handleWaveletList;
+	handlers["PARTICIPANT_INFO"] = &ControllerPrivate::handleParticipantInfo;
+	handlers["PONG"] = &ControllerPrivate::handlePong;
+	handlers["PARTICIPANT_SEARCH"] = &ControllerPrivate::handleParticipantSearch;
+	handlers["WAVELET_ADD_PARTICIPANT"] = &ControllerPrivate::handleWaveletAddParticipant;
+	handlers["WAVELET_REMOVE_PARTICIPANT"] = &ControllerPrivate::handleWaveletRemoveParticipant;
+	handlers["WAVELET_CREATED"] = &ControllerPrivate::handleWaveletCreated;
+	handlers["GADGET_LIST"] = &ControllerPrivate::handleGadgetList;
+	return handlers;
+}
+
+static QHash<QString, ControllerPrivate::WaveletHandler> createWaveletHandlers()
+{
+	QHash<QString, ControllerPrivate::WaveletHandler> handlers;
+	handlers["WAVELET_OPEN"] = &ControllerPrivate::handleWaveletOpen;
+	handlers["OPERATION_MESSAGE_BUNDLE"] = &ControllerPrivate::handleOperationMessageBundle;
+	handlers["OPERATION_MESSAGE_BUNDLE_ACK"] = &ControllerPrivate::handleOperationMessageBundleAck;
+	return handlers;
+}
+
+const QHash<QString, ControllerPrivate::ManagerHandler> & ControllerPrivate::managerHandlers()
+{
+	static const QHash<QString, ManagerHandler> handlers = createManagerHandlers();
+	return handlers;
+}
+
+const QHash<QString, ControllerPrivate::WaveletHandler> & ControllerPrivate::waveletHandlers()
+{
+	static const QHash<QString, WaveletHandler> handlers = createWaveletHandlers();
+	return handlers;
+}
+
+// Manager messages
+
+void ControllerPrivate::handleWaveList(const QVariant &property)
+{
+	// Reconcile with the waves known so far; they may have been loaded from the cache
+	QVariantMap propertyMap = property.toMap();
+	foreach (QByteArray waveId, this->m_allWaves.keys()) {
+		if (!propertyMap.contains(QString::fromAscii(waveId))) {
+			foreach (Wavelet * wavelet, this->m_allWaves[waveId]->allWavelets())
+				this->m_journal.remove(wavelet->id());
+			this->removeWave(waveId, true);
 		}
-		else if (type == "PARTICIPANT_INFO") {
-			QVariantMap propertyMap = property.toMap();
-			this->collectParticipants();
-			foreach (QString s_id, propertyMap.keys()) {
-				QByteArray id = s_id.toAscii();
-				q->participant(id)->updateData(propertyMap[s_id].toMap(), this->m_stompServer);
-			}
-			this->m_participantsTodo.clear(); // Trash
-			this->retrieveParticipants();
-		}
-		else if (type == "PONG") {
-			quint64 ts = this->timestamp();
-			quint64 sentTs = property.toULongLong();
-			if (sentTs != 0 && sentTs < ts)
-				qDebug("Controller: Latency is %llums", ts - sentTs);
-		}
-		else if (type == "PARTICIPANT_SEARCH") {
-			QVariantMap propertyMap = property.toMap();
-			if (propertyMap["result"].toString() == "OK") {
-				QList<QByteArray> ids;
-				this->collectParticipants();
-				foreach (QVariant id, propertyMap["data"].toList()) {
-					q->participant(id.toByteArray());
-					ids.append(id.toByteArray());
-				}
-				this->retrieveParticipants();
-				emit q->participantSearchResults(this->m_lastSearchId, ids);
-			}
-			else if (propertyMap["result"].toString() == "TOO_SHORT")
-				emit q->participantSearchResultsInvalid(this->m_lastSearchId, propertyMap["data"].toInt());
-		}
-		else if (type == "WAVELET_ADD_PARTICIPANT") {
-			QVariantMap propertyMap = property.toMap();
-			QByteArray pid = propertyMap["id"].toByteArray();
-			QByteArray waveletId = propertyMap["waveletId"].toByteArray();
-			Wavelet * wavelet = NULL;
-			if (this->m_allWavelets.contains(waveletId))
-				wavelet = this->m_allWavelets[waveletId];
-			if (!wavelet) {
-				if (pid == this->m_viewerId) { // Someone added me to a new wave, joy!
-					QVariantMap prop;
-					prop["waveId"] = propertyMap["waveId"];
-					this->sendJson("manager", "WAVELET_LIST", prop); // Get the details
-				}
-			}
-			else
-				wavelet->addParticipant(q->participant(pid));
-		}
-		else if (type == "WAVELET_REMOVE_PARTICIPANT") {
-			QVariantMap propertyMap = property.toMap();
-			QByteArray pid = propertyMap["id"].toByteArray();
-			QByteArray waveId = propertyMap["waveId"].toByteArray();
-			QByteArray waveletId = propertyMap["waveletId"].toByteArray();
-			if (this->m_allWavelets.contains(waveletId))
-				this->m_allWavelets[waveletId]->removeParticipant(pid);
-		}
-		else if (type == "WAVELET_CREATED") {
-			QVariantMap propertyMap = property.toMap();
-			QByteArray waveId = propertyMap["waveId"].toByteArray();
-			QByteArray waveletId = propertyMap["waveletId"].toByteArray();
-			if (!this->m_allWaves.contains(waveId))
-				this->m_createdWaveId = waveId;
+	}
+	this->collectParticipants();
+	foreach (QString s_waveId, propertyMap.keys())
+		this->updateWave(s_waveId.toAscii(), propertyMap[s_waveId].toMap(), true);
+	this->retrieveParticipants();
+	this->m_waveCache.saveWaveList(this->m_viewerId, propertyMap);
+	this->schedulePrefetch(propertyMap);
+}
+
+void ControllerPrivate::handleWaveletList(const QVariant &property)
+{
+	QVariantMap propertyMap = property.toMap();
+	this->collectParticipants();
+	this->updateWave(propertyMap["waveId"].toByteArray(), propertyMap["wavelets"].toMap(), false);
+	this->retrieveParticipants();
+}
+
+void ControllerPrivate::handleParticipantInfo(const QVariant &property)
+{
+	P_Q(Controller);
+	QVariantMap propertyMap = property.toMap();
+	this->collectParticipants();
+	foreach (QString s_id, propertyMap.keys()) {
+		QByteArray id = s_id.toAscii();
+		q->participant(id)->updateData(propertyMap[s_id].toMap(), this->m_stompServer);
+		this->m_participantIndex.insert(id, propertyMap[s_id].toMap()["displayName"].toString());
+		this->m_participantCache.insert(id, propertyMap[s_id].toMap());
+		this->m_participantsStale.remove(id);
+	}
+	if (!this->m_participantCache.fileName().isEmpty() && !this->cacheTimer->isActive())
+		this->cacheTimer->start();
+	this->m_participantsTodo.clear(); // Trash
+	this->retrieveParticipants();
+}
+
+void ControllerPrivate::handlePong(const QVariant &property)
+{
+	quint64 ts = this->timestamp();
+	quint64 sentTs = property.toULongLong();
+	if (sentTs != 0 && sentTs <= ts) {
+		this->m_metrics.pingRoundTrip.addSample(ts - sentTs);
+		this->m_keepAliveRoundTrip.addSample(ts - sentTs);
+		this->metricsChanged();
+	}
+}
+
+void ControllerPrivate::handleParticipantSearch(const QVariant &property)
+{
+	P_Q(Controller);
+	QVariantMap propertyMap = property.toMap();
+	if (this->m_serverSearchId != this->m_lastSearchId)
+		return; // Outdated, the user typed on
+	if (propertyMap["result"].toString() == "OK") {
+		// Merge with the local results, which may have been shown already
+		QList<QByteArray> ids = this->m_localResults;
+		this->collectParticipants();
+		foreach (QVariant id, propertyMap["data"].toList()) {
+			q->participant(id.toByteArray());
+			if (!ids.contains(id.toByteArray()))
+				ids.append(id.toByteArray());
+		}
+		this->retrieveParticipants();
+		emit q->participantSearchResults(this->m_serverSearchId, ids);
+	}
+	else if (propertyMap["result"].toString() == "TOO_SHORT" && this->m_localResults.isEmpty())
+		emit q->participantSearchResultsInvalid(this->m_serverSearchId, propertyMap["data"].toInt());
+}
+
+void ControllerPrivate::handleWaveletAddParticipant(const QVariant &property)
+{
+	P_Q(Controller);
+	QVariantMap propertyMap = property.toMap();
+	QByteArray pid = propertyMap["id"].toByteArray();
+	QByteArray waveletId = propertyMap["waveletId"].toByteArray();
+	Wavelet * wavelet = NULL;
+	if (this->m_allWavelets.contains(waveletId))
+		wavelet = this->m_allWavelets[waveletId];
+	if (!wavelet) {
+		if (pid == this->m_viewerId) { // Someone added me to a new wave, joy!
 			QVariantMap prop;
 			prop["waveId"] = propertyMap["waveId"];
-			this->sendJson("manager", "WAVELET_LIST", prop); // Reload wave
-		}
-		else if (type == "GADGET_LIST") {
-			QVariantList propertyList = property.toList();
-			this->m_cachedGadgetList.clear();
-			foreach (QVariant var, propertyList) {
-				QVariantMap gadgetInfo = var.toMap();
-				QHash<QString,QString> gadgetInfoClean;
-				foreach (QString entry, gadgetInfo.keys())
-					gadgetInfoClean[entry] = gadgetInfo[entry].toString();
-				this->m_cachedGadgetList.append(gadgetInfoClean);
-			}
-			emit q->updateGadgetList(this->m_cachedGadgetList);
+			this->sendJson("manager", "WAVELET_LIST", prop); // Get the details
 		}
-		return;
 	}
+	else
+		wavelet->addParticipant(q->participant(pid));
+}
 
-	// Wavelet messages
-	Q_ASSERT(this->m_allWavelets.contains(waveletId));
-	Wavelet * wavelet = this->m_allWavelets[waveletId];
-	if (wavelet) {
-		if (type == "WAVELET_OPEN") {
-			QVariantMap propertyMap = property.toMap();
-			QVariantMap blips = propertyMap["blips"].toMap();
-			QVariantMap waveletMap = propertyMap["wavelet"].toMap();
-			QByteArray rootBlipId = waveletMap["rootBlipId"].toByteArray();
-			wavelet->loadBlipsFromSnapshot(blips, rootBlipId);
-			this->m_openWavelets.insert(wavelet->id());
-			emit q->waveletOpened(wavelet->id(), wavelet->isRoot());
-		}
-		else if (type == "OPERATION_MESSAGE_BUNDLE") {
-			QVariantMap propertyMap = property.toMap();
-			this->queueMessageBundle(
-					wavelet,
-					false,
-					propertyMap["operations"],
-					propertyMap["version"].toInt(),
-					propertyMap["blipsums"].toMap(),
-					parseTimestamp(propertyMap["timestamp"]),
-					propertyMap["contributor"].toByteArray()
-				);
+void ControllerPrivate::handleWaveletRemoveParticipant(const QVariant &property)
+{
+	QVariantMap propertyMap = property.toMap();
+	QByteArray pid = propertyMap["id"].toByteArray();
+	QByteArray waveletId = propertyMap["waveletId"].toByteArray();
+	if (this->m_allWavelets.contains(waveletId))
+		this->m_allWavelets[waveletId]->removeParticipant(pid);
+}
+
+void ControllerPrivate::handleWaveletCreated(const QVariant &property)
+{
+	QVariantMap propertyMap = property.toMap();
+	QByteArray waveId = propertyMap["waveId"].toByteArray();
+	if (!this->m_allWaves.contains(waveId))
+		this->m_createdWaveId = waveId;
+	QVariantMap prop;
+	prop["waveId"] = propertyMap["waveId"];
+	this->sendJson("manager", "WAVELET_LIST", prop); // Reload wave
+}
+
+void ControllerPrivate::handleGadgetList(const QVariant &property)
+{
+	P_Q(Controller);
+	QVariantList propertyList = property.toList();
+	this->m_cachedGadgetList.clear();
+	foreach (QVariant var, propertyList) {
+		QVariantMap gadgetInfo = var.toMap();
+		QHash<QString,QString> gadgetInfoClean;
+		foreach (QString entry, gadgetInfo.keys())
+			gadgetInfoClean[entry] = gadgetInfo[entry].toString();
+		this->m_cachedGadgetList.append(gadgetInfoClean);
+	}
+	emit q->updateGadgetList(this->m_cachedGadgetList);
+}
+
+// Wavelet messages
+
+void ControllerPrivate::handleWaveletOpen(Wavelet * wavelet, const QVariant &property)
+{
+	P_Q(Controller);
+	this->flushInbound(wavelet->id()); // Bundles received before belong to the old state
+	QVariantMap propertyMap = property.toMap();
+	QVariantMap waveletMap = propertyMap["wavelet"].toMap();
+	if (this->m_prefetching == wavelet->id()) {
+		// Only store the snapshot, the wavelet was not opened
+		this->m_prefetching.clear();
+		if (!propertyMap["unchanged"].toBool() && waveletMap.contains("version")) {
+			this->m_cachedVersions[wavelet->id()] = waveletMap["version"].toInt();
+			this->m_waveCache.saveSnapshot(wavelet->id(), waveletMap["version"].toInt(), propertyMap);
 		}
-		else if (type == "OPERATION_MESSAGE_BUNDLE_ACK") {
-			QVariantMap propertyMap = property.toMap();
-			this->queueMessageBundle(
-					wavelet,
-					true,
-					propertyMap["newblips"],
-					propertyMap["version"].toInt(),
-					propertyMap["blipsums"].toMap(),
-					parseTimestamp(propertyMap["timestamp"]),
-					propertyMap["contributor"].toByteArray()
-				);
+		this->unsubscribeWavelet(wavelet->id());
+		this->prefetchTimer->start();
+		return;
+	}
+	if (this->m_inflightCheck.remove(wavelet->id()) && this->checkInflight(wavelet, propertyMap))
+		return; // Sent again, the snapshot is the state it is based on
+	bool dormant = this->m_dormantWavelets.remove(wavelet->id());
+	if (propertyMap["unchanged"].toBool()) {
+		// The cached snapshot or dormant model which is shown already is up to date
+		if (this->m_openWavelets.contains(wavelet->id()) && (dormant || this->m_cachedVersions.contains(wavelet->id()))) {
+			if (this->m_resyncSnapshot.remove(wavelet->id()) && this->mcached[wavelet->id()]->canFetch() && !this->hasPendingOperations(wavelet->id()))
+				this->transferOperations(wavelet->id());
+			return;
 		}
-		else if (type == "GADGET_LIST") {
+		qWarning("Controller: Server reported an unchanged snapshot for '%s', but there is none!", wavelet->id().constData());
+		this->sendJson(wavelet->id(), "WAVELET_OPEN", QVariant());
+		return;
+	}
+	QVariantMap blips = propertyMap["blips"].toMap();
+	QByteArray rootBlipId = waveletMap["rootBlipId"].toByteArray();
+	wavelet->loadBlipsFromSnapshot(blips, rootBlipId);
+	if (waveletMap.contains("version")) {
+		wavelet->setVersion(waveletMap["version"].toInt());
+		if (!this->m_cachedVersions.contains(wavelet->id()) || this->m_cachedVersions[wavelet->id()] != wavelet->version()) {
+			this->m_cachedVersions[wavelet->id()] = wavelet->version();
+			this->m_waveCache.saveSnapshot(wavelet->id(), wavelet->version(), propertyMap);
 		}
 	}
+	if (this->m_resyncSnapshot.remove(wavelet->id())) {
+		// Edits made while waiting for the snapshot are not part of it yet
+		OpManager * mcached = this->mcached[wavelet->id()];
+		wavelet->applyOperations(mcached->operations(), QDateTime::currentDateTime(), this->m_viewerId);
+		if (mcached->canFetch() && !this->hasPendingOperations(wavelet->id()))
+			this->transferOperations(wavelet->id());
+	}
+	if (this->m_resync.contains(wavelet->id()) && !this->hasPendingOperations(wavelet->id())) {
+		// Checked the bundle in flight and nothing else is left to send
+		this->m_journalBase.remove(wavelet->id());
+		if (!this->m_resync.take(wavelet->id())) {
+			this->unsubscribeWavelet(wavelet->id());
+			return;
+		}
+	}
+	if (!this->m_openWavelets.contains(wavelet->id())) {
+		this->m_openWavelets.insert(wavelet->id());
+		emit q->waveletOpened(wavelet->id(), wavelet->isRoot());
+	}
+}
+
+void ControllerPrivate::handleOperationMessageBundle(Wavelet * wavelet, const QVariant &property)
+{
+	this->m_metrics.inboundBundles.tick();
+	this->metricsChanged();
+	QVariantMap propertyMap = property.toMap();
+	this->queueMessageBundle(
+			wavelet,
+			propertyMap["operations"],
+			propertyMap["version"].toInt(),
+			propertyMap["blipsums"].toMap(),
+			parseTimestamp(propertyMap["timestamp"]),
+			propertyMap["contributor"].toByteArray()
+		);
+}
+
+void ControllerPrivate::handleOperationMessageBundleAck(Wavelet * wavelet, const QVariant &property)
+{
+	QVariantMap propertyMap = property.toMap();
+	// Not held back for the next display frame, the next bundle waits for it;
+	// bundles received before are applied first to keep the order
+	this->flushInbound(wavelet->id());
+	this->processMessageBundle(
+			wavelet,
+			true,
+			propertyMap["newblips"],
+			propertyMap["version"].toInt(),
+			propertyMap["blipsums"].toMap(),
+			parseTimestamp(propertyMap["timestamp"]),
+			propertyMap["contributor"].toByteArray()
+		);
 }
 
 void Controller::textInserted(const QByteArray &waveletId, const QByteArray &blipId, int index, const QString &content)
@@ -790,10 +1503,20 @@ void ControllerPrivate::_q_mcached_afterOperationsInserted(int /*start*/, int /*
 	OpManager * mcached = qobject_cast<OpManager*>(q->sender());
 	Q_ASSERT(mcached);
 	QByteArray waveletId = mcached->waveletId();
+	q->markWaveletViewed(waveletId); // Edited, so it is being looked at
+	this->journalWavelet(waveletId);
 	if (!this->hasPendingOperations(waveletId))
 		this->transferOperations(waveletId);
 }
 
+void ControllerPrivate::_q_mcached_operationsChanged()
+{
+	P_Q(Controller);
+	OpManager * mcached = qobject_cast<OpManager*>(q->sender());
+	Q_ASSERT(mcached);
+	this->journalWavelet(mcached->waveletId());
+}
+
 void ControllerPrivate::_q_wavelet_participantsChanged()
 {
 	P_Q(Controller);
@@ -802,11 +1525,16 @@ void ControllerPrivate::_q_wavelet_participantsChanged()
 	if (!wavelet->participant(this->m_viewerId)) { // I got kicked
 		WaveModel * wave = wavelet->waveModel();
 		QByteArray waveletId = wavelet->id();
+		this->m_journal.remove(waveletId); // Edits cannot be sent anymore
+		this->m_journalDirty.remove(waveletId);
+		this->m_inflight.remove(waveletId);
 		if (wavelet == wave->rootWavelet()) // It was the root wavelet, oh no!
 			this->removeWave(wave->id(), true);
 		else { // Some other wavelet I was on, phew...
 			wave->removeWavelet(waveletId);
 			this->m_allWavelets.remove(waveletId);
+			this->m_routes.remove(this->m_waveAccessKeyRx + "." + waveletId + ".waveop");
+			this->m_metrics.waveletAckLatency.remove(waveletId);
 		}
 		// Wavelet has been closed implicitly
 		this->m_openWavelets.remove(waveletId);
@@ -819,9 +1547,22 @@ bool ControllerPrivate::hasPendingOperations(const QByteArray &waveletId)
 	return this->ispending[waveletId] || !this->mpending[waveletId]->isEmpty();
 }
 
+bool ControllerPrivate::hasUnsentOperations(const QByteArray &waveletId)
+{
+	return !this->mpending[waveletId]->isEmpty() || !this->mcached[waveletId]->isEmpty();
+}
+
+static QByteArray contentChecksum(const QString &content)
+{
+	return QCryptographicHash::hash(content.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
 void ControllerPrivate::transferOperations(const QByteArray &waveletId)
 {
 	Q_ASSERT(this->mpending.contains(waveletId));
+	if (this->m_state != Controller::ClientOnline || this->m_resyncSnapshot.contains(waveletId))
+		return; // Kept in the journal until the wavelet can be synchronized
+
 	OpManager * mp = this->mpending[waveletId];
 	OpManager * mc = this->mcached[waveletId];
 	Wavelet * model = this->m_allWavelets[waveletId];
@@ -832,24 +1573,189 @@ void ControllerPrivate::transferOperations(const QByteArray &waveletId)
 	if (mp->isEmpty())
 		return;
 
+	// Remember the bundle as sent, together with what the touched blips look
+	// like once it is applied, to tell after a lost connection whether the
+	// server got it; it is journaled before it leaves
+	QVariantMap bundle;
+	bundle["version"] = model->version();
+	bundle["operations"] = mp->serialize();
+	QVariantMap blipsums;
+	foreach (Operation * op, mp->operations()) {
+		QByteArray blipId = op->blipId();
+		if (blipId.isEmpty() || blipId.startsWith("TBD_") || blipsums.contains(QString::fromAscii(blipId)))
+			continue;
+		Blip * blip = model->blipById(blipId);
+		blipsums[QString::fromAscii(blipId)] = blip ? contentChecksum(blip->content()) : QByteArray(); // Deleted
+	}
+	bundle["blipsums"] = blipsums;
+	bundle["blipCount"] = model->allBlipIDs().size();
+	this->m_inflight[waveletId] = bundle;
+	this->journalWavelet(waveletId);
+
 	//if (!this->isBlocked(waveletId)) {
+	this->sendBundle(waveletId, bundle);
+	//}
+}
+
+void ControllerPrivate::sendBundle(const QByteArray &waveletId, const QVariantMap &bundle)
+{
 	this->ispending[waveletId] = true;
 	if (this->pendingTimer->isActive())
 		this->pendingTimer->stop();
 	this->pendingTimer->start();
 
-	QVariantMap bundle;
-	bundle["version"] = model->version();
-	bundle["operations"] = mp->serialize();
-	this->sendJson(waveletId, "OPERATION_MESSAGE_BUNDLE", bundle);
-	//}
+	QVariantMap message;
+	message["version"] = bundle["version"];
+	message["operations"] = bundle["operations"];
+	this->m_bundleSentAt[waveletId] = monotonicMicroseconds();
+	this->sendJson(waveletId, "OPERATION_MESSAGE_BUNDLE", message);
+}
+
+/*!
+	\internal
+	Decides from the current \a snapshot whether the bundle which was in flight
+	when the connection dropped reached the server. If the wavelet is still at
+	the version it was sent at, it did not; it is sent again unchanged and true
+	is returned. If the wavelet advanced by one version to the contents the
+	bundle leads to, it was applied. Otherwise it cannot be told apart from the
+	edits of others and is dropped with a warning, as applying it twice would
+	duplicate text. In these cases the snapshot replaces the model like after
+	any resynchronisation and false is returned.
+*/
+bool ControllerPrivate::checkInflight(Wavelet * wavelet, const QVariantMap &snapshot)
+{
+	QByteArray waveletId = wavelet->id();
+	QVariantMap bundle = this->m_inflight.value(waveletId);
+	int sentVersion = bundle["version"].toInt();
+	int version = snapshot["wavelet"].toMap()["version"].toInt();
+	if (version == sentVersion) {
+		this->sendBundle(waveletId, bundle);
+		return true;
+	}
+
+	QVariantMap blips = snapshot["blips"].toMap();
+	bool applied = version == sentVersion + 1 && blips.size() == bundle["blipCount"].toInt();
+	QVariantMap blipsums = bundle["blipsums"].toMap();
+	foreach (QString blipId, blipsums.keys()) {
+		QByteArray sum;
+		if (blips.contains(blipId))
+			sum = contentChecksum(blips[blipId].toMap()["content"].toString());
+		if (sum != blipsums[blipId].toByteArray())
+			applied = false;
+	}
+	if (!applied)
+		qWarning("Controller: Cannot tell whether the last edits on '%s' reached the server, dropping them!", waveletId.constData());
+
+	qDeleteAll(this->mpending[waveletId]->fetch());
+	this->m_inflight.remove(waveletId);
+	this->ispending[waveletId] = false;
+	this->m_resyncSnapshot.insert(waveletId);
+	this->journalWavelet(waveletId);
+	return false;
+}
+
+void ControllerPrivate::resyncWavelet(const QByteArray &waveletId, bool open)
+{
+	// The wavelet missed the messages of the offline period; its operations
+	// are transformed by the server, then the current snapshot is fetched
+	this->m_resync[waveletId] = open;
+	this->m_resyncSnapshot.remove(waveletId); // Sent at the version they are based on
+	this->subscribeWavelet(waveletId, false);
+	if (this->m_inflight.contains(waveletId)) {
+		// The bundle in flight when the connection dropped may have been
+		// applied already; the snapshot tells whether to send it again
+		this->m_inflightCheck.insert(waveletId);
+		this->sendJson(waveletId, "WAVELET_OPEN", QVariantMap());
+		return;
+	}
+	this->transferOperations(waveletId);
+	if (!this->ispending[waveletId])
+		this->finishResync(waveletId); // Nothing could be sent, e.g. drafts only
+}
+
+void ControllerPrivate::finishResync(const QByteArray &waveletId)
+{
+	this->m_journalBase.remove(waveletId); // Restored edits are on the server now
+	if (this->m_resync.take(waveletId)) {
+		this->m_resyncSnapshot.insert(waveletId);
+		this->sendJson(waveletId, "WAVELET_OPEN", QVariantMap());
+	}
+	else
+		this->unsubscribeWavelet(waveletId, false);
+}
+
+/*!
+	\internal
+	Writes the unacknowledged operations of \a waveletId to the journal right
+	away, or removes it if there are none. While inbound operations are being
+	transformed, the wavelet is written once they have been applied.
+*/
+void ControllerPrivate::journalWavelet(const QByteArray &waveletId)
+{
+	if (!this->m_journal.isEnabled() || !this->m_allWavelets.contains(waveletId))
+		return;
+	if (this->m_journalHeld) {
+		this->m_journalDirty.insert(waveletId);
+		return;
+	}
+	if (this->hasUnsentOperations(waveletId))
+		this->m_journal.append(
+				waveletId,
+				this->m_allWavelets[waveletId]->version(),
+				this->mpending[waveletId]->serialize(),
+				this->mcached[waveletId]->serialize(),
+				this->m_inflight.value(waveletId)
+			);
+	else
+		this->m_journal.remove(waveletId);
+}
+
+void ControllerPrivate::restoreJournal()
+{
+	// Edits which were not acknowledged before the last session ended
+	foreach (QByteArray id, this->m_journal.waveletIds()) {
+		int version = 0;
+		QVariantList pending, cached;
+		QVariantMap inflight;
+		if (!this->m_allWavelets.contains(id) || !this->m_journal.load(id, &version, &pending, &cached, &inflight)) {
+			this->m_journal.remove(id);
+			continue;
+		}
+		if (this->hasUnsentOperations(id))
+			continue; // Still in memory
+		this->mpending[id]->unserialize(pending);
+		this->mcached[id]->unserialize(cached);
+		this->m_allWavelets[id]->setVersion(version);
+		this->m_journalBase[id] = version;
+		if (!inflight.isEmpty())
+			this->m_inflight[id] = inflight;
+	}
 }
 
 int Controller::searchForParticipant(const QString &text)
 {
 	P_D(Controller);
-	d->sendJson("manager", "PARTICIPANT_SEARCH", text);
-	return ++d->m_lastSearchId;
+	d->m_searchText = text;
+	d->m_lastSearchId++;
+	// Known participants are found right away, the server is asked once typing pauses
+	d->m_localResults = d->m_participantIndex.search(text);
+	if (!d->m_localResults.isEmpty())
+		QTimer::singleShot(0, this, SLOT(_q_emitLocalSearchResults()));
+	d->searchTimer->start();
+	return d->m_lastSearchId;
+}
+
+void ControllerPrivate::_q_emitLocalSearchResults()
+{
+	P_Q(Controller);
+	if (!this->m_localResults.isEmpty())
+		emit q->participantSearchResults(this->m_lastSearchId, this->m_localResults);
+}
+
+void ControllerPrivate::_q_searchTimer_timeout()
+{
+	this->m_serverSearchId = this->m_lastSearchId;
+	this->sendJson("manager", "PARTICIPANT_SEARCH", this->m_searchText);
 }
 
 QList< QHash<QString,QString> > Controller::gadgetList()
@@ -860,55 +1766,228 @@ QList< QHash<QString,QString> > Controller::gadgetList()
 	return d->m_cachedGadgetList;
 }
 
+void ControllerPrivate::loadCaches()
+{
+	if (this->m_cacheDirectory.isEmpty()) {
+		this->m_participantCache.setFileName(QString());
+		this->m_waveCache.setDirectory(QString());
+		this->m_journal.setDirectory(QString());
+		return;
+	}
+	QString server = this->m_stompServer;
+	server.replace(QRegExp("[^A-Za-z0-9._-]"), "_");
+	QString user = this->m_username;
+	user.replace(QRegExp("[^A-Za-z0-9._-]"), "_");
+	if (user.isEmpty())
+		this->m_waveCache.setDirectory(QString());
+	else
+		this->m_waveCache.setDirectory(QDir(this->m_cacheDirectory).filePath("waves-" + server + "-" + user));
+	this->m_journal.setDirectory(this->m_waveCache.directory());
+
+	QString fileName = QDir(this->m_cacheDirectory).filePath("participants-" + server + ".dat");
+	if (this->m_participantCache.fileName() == fileName)
+		return;
+	this->saveCaches();
+	this->m_participantCache.setFileName(fileName);
+	this->m_participantCache.load();
+	foreach (QByteArray id, this->m_participantCache.ids()) // Everyone seen before can be found
+		this->m_participantIndex.insert(id, this->m_participantCache.data(id)["displayName"].toString());
+}
+
+void ControllerPrivate::saveCaches()
+{
+	if (this->m_participantCache.isDirty())
+		this->m_participantCache.save();
+}
+
+void ControllerPrivate::_q_cacheTimer_timeout()
+{
+	// Revalidate expired participants in one batch
+	if (this->m_state == Controller::ClientOnline && !this->m_participantsStale.isEmpty()) {
+		QVariantList l;
+		foreach (QByteArray id, this->m_participantsStale)
+			l << QString::fromAscii(id);
+		this->sendJson("manager", "PARTICIPANT_INFO", l);
+		this->m_participantsStale.clear();
+	}
+	this->saveCaches();
+}
+
 void ControllerPrivate::_q_pendingTimer_timeout()
 {
 	//TODO
 }
 
-void ControllerPrivate::queueMessageBundle(Wavelet * wavelet, bool ack, const QVariant &serial_ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor)
+void ControllerPrivate::queueMessageBundle(Wavelet * wavelet, const QVariant &serial_ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor)
 {
-	//TODO
-	this->processMessageBundle(wavelet, ack, serial_ops, version, blipsums, timestamp, contributor);
+	if (this->m_replay || this->m_updateInterval <= 0) {
+		this->processMessageBundle(wavelet, false, serial_ops, version, blipsums, timestamp, contributor);
+		return;
+	}
+	QueuedBundle bundle;
+	bundle.serial_ops = serial_ops;
+	bundle.version = version;
+	bundle.blipsums = blipsums;
+	bundle.timestamp = timestamp;
+	bundle.contributor = contributor;
+	this->m_inbound[wavelet->id()].append(bundle);
+
+	// The timer is not restarted, so no bundle waits longer than one interval,
+	// unless the event loop is flooded; then the latency cap applies
+	quint64 now = monotonicMicroseconds();
+	if (!this->inboundTimer->isActive()) {
+		this->m_inboundSince = now;
+		this->inboundTimer->start(this->m_updateInterval);
+	}
+	else if (now - this->m_inboundSince >= this->m_updateLatencyCap * 1000llu)
+		this->flushInbound();
 }
 
-void ControllerPrivate::processMessageBundle(Wavelet * wavelet, bool ack, const QVariant &serial_ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor)
+void ControllerPrivate::flushInbound(const QByteArray &waveletId)
 {
-	OpManager * mpending = this->mpending[wavelet->id()];
-	OpManager * mcached = this->mcached[wavelet->id()];
+	QList<QByteArray> ids;
+	if (waveletId.isEmpty())
+		ids = this->m_inbound.keys();
+	else
+		ids.append(waveletId);
+	foreach (QByteArray id, ids) {
+		QList<QueuedBundle> bundles = this->m_inbound.take(id);
+		Wavelet * wavelet = this->m_allWavelets.value(id);
+		if (!wavelet)
+			continue;
+		// Apply consecutive bundles of the same contributor in one go
+		QList<Operation*> batch;
+		int last = -1;
+		for (int i = 0; i < bundles.size(); i++) {
+			const QueuedBundle &bundle = bundles.at(i);
+			if (last != -1 && bundle.contributor != bundles.at(last).contributor) {
+				const QueuedBundle &prev = bundles.at(last);
+				this->applyBundle(wavelet, batch, prev.version, prev.blipsums, prev.timestamp, prev.contributor);
+				batch.clear();
+			}
+			batch += this->transformBundle(wavelet, bundle.serial_ops, bundle.contributor);
+			last = i;
+		}
+		if (last != -1) {
+			const QueuedBundle &prev = bundles.at(last);
+			this->applyBundle(wavelet, batch, prev.version, prev.blipsums, prev.timestamp, prev.contributor);
+		}
+	}
+	if (this->m_inbound.isEmpty())
+		this->inboundTimer->stop();
+}
 
-	if (!ack) {
-		OpManager delta(wavelet->waveId(), wavelet->id(), contributor);
-		delta.unserialize(serial_ops.toList());
+/*!
+	\internal
+	Schedules metricsUpdated(); it is emitted at most once per second, however
+	many bundles and ACKs arrive in between.
+*/
+void ControllerPrivate::metricsChanged()
+{
+	if (!this->metricsTimer->isActive())
+		this->metricsTimer->start();
+}
+
+void ControllerPrivate::_q_metricsTimer_timeout()
+{
+	P_Q(Controller);
+	emit q->metricsUpdated();
+}
 
-		QList<Operation*> ops;
+void ControllerPrivate::_q_inboundTimer_timeout()
+{
+	this->flushInbound();
+}
 
-		// Iterate over all operations
-		foreach (Operation * incoming, delta.operations()) {
-			// Transform pending operations, iterate over results
-			foreach (Operation * tr, mpending->transform(incoming)) {
-				// Transform cached operations, save results
-				ops.append(mcached->transform(tr));
+// Merges adjacent insertions and deletions typed one character at a time
+static void coalesceOperations(QList<Operation*> &ops)
+{
+	for (int i = 1; i < ops.size(); ) {
+		Operation * prev = ops.at(i-1);
+		Operation * op = ops.at(i);
+		bool merged = false;
+		if (prev->blipId() == op->blipId() && prev->type() == op->type()) {
+			if (op->type() == Operation::DOCUMENT_INSERT && op->index() == prev->index() + prev->length()) {
+				prev->insertString(prev->length(), op->property().toString());
+				merged = true;
+			}
+			else if (op->type() == Operation::DOCUMENT_DELETE && op->index() == prev->index()) {
+				prev->resize(prev->length() + op->length()); // Forward deletion
+				merged = true;
 			}
 		}
+		if (merged)
+			delete ops.takeAt(i);
+		else
+			i++;
+	}
+}
 
-		// Apply operations
-		this->collectParticipants();
-		wavelet->applyOperations(ops, timestamp, contributor);
-		this->retrieveParticipants();
+QList<Operation*> ControllerPrivate::transformBundle(Wavelet * wavelet, const QVariant &serial_ops, const QByteArray &contributor)
+{
+	OpManager * mpending = this->mpending[wavelet->id()];
+	OpManager * mcached = this->mcached[wavelet->id()];
 
-		// Set version and checkup
-		wavelet->setVersion(version);
-		if (!this->hasPendingOperations(wavelet->id()) && mcached->isEmpty()) {
-			QMap<QByteArray,QByteArray> blipsums_prep;
-			foreach (QString key, blipsums.keys())
-				blipsums_prep[key.toAscii()] = blipsums[key].toByteArray();
-			wavelet->checkSync(blipsums_prep);
+	OpManager delta(wavelet->waveId(), wavelet->id(), contributor);
+	delta.unserialize(serial_ops.toList());
+
+	QList<Operation*> ops;
+	this->m_journalHeld = true; // Written by applyBundle()
+
+	// Iterate over all operations
+	foreach (Operation * incoming, delta.operations()) {
+		// Transform pending operations, iterate over results
+		foreach (Operation * tr, mpending->transform(incoming)) {
+			// Transform cached operations, save copies of the results
+			foreach (Operation * op, mcached->transform(tr))
+				ops.append(op->clone());
 		}
 	}
+	this->m_journalHeld = false;
+	return ops;
+}
+
+void ControllerPrivate::applyBundle(Wavelet * wavelet, QList<Operation*> ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor)
+{
+	coalesceOperations(ops);
+
+	// Apply operations
+	this->collectParticipants();
+	wavelet->applyOperations(ops, timestamp, contributor);
+	this->retrieveParticipants();
+	qDeleteAll(ops);
+
+	// Set version and checkup
+	wavelet->setVersion(version);
+	if (this->m_journalDirty.remove(wavelet->id()) || this->hasUnsentOperations(wavelet->id()))
+		this->journalWavelet(wavelet->id()); // Transformed, new base version
+	if (!this->hasPendingOperations(wavelet->id()) && this->mcached[wavelet->id()]->isEmpty()) {
+		QMap<QByteArray,QByteArray> blipsums_prep;
+		foreach (QString key, blipsums.keys())
+			blipsums_prep[key.toAscii()] = blipsums[key].toByteArray();
+		wavelet->checkSync(blipsums_prep);
+	}
+}
+
+void ControllerPrivate::processMessageBundle(Wavelet * wavelet, bool ack, const QVariant &serial_ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor)
+{
+	OpManager * mpending = this->mpending[wavelet->id()];
+	OpManager * mcached = this->mcached[wavelet->id()];
+
+	if (!ack)
+		this->applyBundle(wavelet, this->transformBundle(wavelet, serial_ops, contributor), version, blipsums, timestamp, contributor);
 	else { // ACK message
 		this->pendingTimer->stop();
+		if (this->m_bundleSentAt.contains(wavelet->id())) {
+			double latency = (monotonicMicroseconds() - this->m_bundleSentAt.take(wavelet->id())) / 1000.0;
+			this->m_metrics.ackLatency.addSample(latency);
+			this->m_metrics.waveletAckLatency[wavelet->id()].addSample(latency);
+			this->metricsChanged();
+		}
 		wavelet->setVersion(version);
 		mpending->fetch(); // Clear
+		this->m_inflight.remove(wavelet->id());
+		this->journalWavelet(wavelet->id());
 
 		// Update Blip IDs
 		QList<QByteArray> & draftblips = this->draftblips[wavelet->id()];
@@ -926,11 +2005,14 @@ void ControllerPrivate::processMessageBundle(Wavelet * wavelet, bool ack, const
 			}
 		}
 
-		if (!mcached->isEmpty()) {
-			if (mcached->canFetch())
-				this->transferOperations(wavelet->id()); // Send cached
+		if (!mcached->isEmpty() && mcached->canFetch())
+			this->transferOperations(wavelet->id()); // Send cached
+		else if (this->m_resync.contains(wavelet->id())) {
+			// Sent everything from the offline period, the model is outdated
+			this->ispending[wavelet->id()] = false;
+			this->finishResync(wavelet->id());
 		}
-		else {
+		else if (mcached->isEmpty()) {
 			// All done, we can do a check-up
 			QMap<QByteArray,QByteArray> blipsums_prep;
 			foreach (QString key, blipsums.keys())
@@ -24,6 +24,8 @@
 #include "pygowave_api_global.h"
 
 #include "model.h"
+#include "metrics.h"
+#include "recorder.h"
 
 #include <QtNetwork/QAbstractSocket>
 
@@ -73,6 +75,33 @@ namespace PyGoWave {
 
 		QList< QHash<QString,QString> > gadgetList();
 
+		int compressionThreshold() const;
+		void setCompressionThreshold(int bytes);
+
+		int updateInterval() const;
+		void setUpdateInterval(int msecs);
+
+		int keepAliveInterval() const;
+		void setKeepAliveInterval(int minimum, int maximum);
+
+		QString cacheDirectory() const;
+		void setCacheDirectory(const QString &path);
+		int participantCacheTtl() const;
+		void setParticipantCacheTtl(int seconds);
+		int prefetchCount() const;
+		void setPrefetchCount(int count);
+		int idleUnsubscribeTimeout() const;
+		void setIdleUnsubscribeTimeout(int seconds);
+
+		bool offlineEditing() const;
+		void setOfflineEditing(bool enabled);
+
+		FrameRecorder * frameRecorder() const;
+		void setFrameRecorder(FrameRecorder * recorder);
+
+		ControllerMetrics metrics() const;
+		void resetMetrics();
+
 	signals:
 		void stateChanged(int);
 		void errorOccurred(const QByteArray &waveletId, const QString &tag, const QString &desc);
@@ -85,6 +114,8 @@ namespace PyGoWave {
 
 		void updateGadgetList(const QList< QHash<QString,QString> > &gadgetList);
 
+		void metricsUpdated();
+
 	public slots:
 		void textInserted(const QByteArray &waveletId, const QByteArray &blipId, int index, const QString &content);
 		void textDeleted(const QByteArray &waveletId, const QByteArray &blipId, int start, int end);
@@ -98,7 +129,9 @@ namespace PyGoWave {
 		void draftBlip(const QByteArray &waveletId, const QByteArray &blipId, bool enabled);
 
 		void openWavelet(const QByteArray &waveletId);
+		void openWavelets(const QList<QByteArray> &waveletIds);
 		void closeWavelet(const QByteArray &waveletId);
+		void markWaveletViewed(const QByteArray &waveletId);
 		void addParticipant(const QByteArray &waveletId, const QByteArray &id);
 		void createNewWave(const QString &title);
 		void createNewWavelet(const QByteArray &waveId, const QString &title);
@@ -108,17 +141,28 @@ namespace PyGoWave {
 
 	private:
 		Q_DISABLE_COPY(Controller)
+		friend class FrameReplayer;
+		friend class FrameReplayerPrivate;
 
 		Q_PRIVATE_SLOT(pd_func(), void _q_conn_socketConnected())
 		Q_PRIVATE_SLOT(pd_func(), void _q_conn_socketDisconnected())
 		Q_PRIVATE_SLOT(pd_func(), void _q_conn_frameReceived())
 		Q_PRIVATE_SLOT(pd_func(), void _q_conn_socketStateChanged(QAbstractSocket::SocketState))
 		Q_PRIVATE_SLOT(pd_func(), void _q_conn_socketError(QAbstractSocket::SocketError))
+		Q_PRIVATE_SLOT(pd_func(), void _q_decoder_resultsReady())
 
 		Q_PRIVATE_SLOT(pd_func(), void _q_pingTimer_timeout())
 		Q_PRIVATE_SLOT(pd_func(), void _q_pendingTimer_timeout())
+		Q_PRIVATE_SLOT(pd_func(), void _q_cacheTimer_timeout())
+		Q_PRIVATE_SLOT(pd_func(), void _q_prefetchTimer_timeout())
+		Q_PRIVATE_SLOT(pd_func(), void _q_idleTimer_timeout())
+		Q_PRIVATE_SLOT(pd_func(), void _q_inboundTimer_timeout())
+		Q_PRIVATE_SLOT(pd_func(), void _q_searchTimer_timeout())
+		Q_PRIVATE_SLOT(pd_func(), void _q_metricsTimer_timeout())
+		Q_PRIVATE_SLOT(pd_func(), void _q_emitLocalSearchResults())
 
 		Q_PRIVATE_SLOT(pd_func(), void _q_mcached_afterOperationsInserted(int start, int end))
+		Q_PRIVATE_SLOT(pd_func(), void _q_mcached_operationsChanged())
 		Q_PRIVATE_SLOT(pd_func(), void _q_wavelet_participantsChanged())
 
 		ControllerPrivate * const pd_ptr;
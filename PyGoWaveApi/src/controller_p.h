@@ -22,9 +22,39 @@
 #define CONTROLLER_P_H
 
 #include "pygowave_api_global.h"
+#include "cache_p.h"
+#include "framedecoder_p.h"
+#include "participantindex_p.h"
+
+#include <QtCore/QPointer>
+#include <QtCore/QDateTime>
+
+class QStompResponseFrame;
 
 namespace PyGoWave {
 
+	struct Route
+	{
+		enum Kind {
+			LoginRoute,
+			ManagerRoute,
+			WaveletRoute
+		};
+
+		Kind kind;
+		QByteArray id;
+		QPointer<Wavelet> wavelet;
+	};
+
+	struct QueuedBundle
+	{
+		QVariant serial_ops;
+		int version;
+		QVariantMap blipsums;
+		QDateTime timestamp;
+		QByteArray contributor;
+	};
+
 	class ControllerPrivate
 	{
 		P_DECLARE_PUBLIC(Controller)
@@ -32,10 +62,18 @@ namespace PyGoWave {
 			ControllerPrivate(Controller * q);
 
 			QStompClient * conn;
+			FrameDecoder * decoder;
+			int m_decodeThreshold;
 			QJson::Serializer * jserializer;
 			QJson::Parser * jparser;
 			QTimer * pingTimer;
 			QTimer * pendingTimer;
+			QTimer * cacheTimer;
+			QTimer * prefetchTimer;
+			QTimer * idleTimer;
+			QTimer * inboundTimer;
+			QTimer * searchTimer;
+			QTimer * metricsTimer;
 
 			QString m_stompServer;
 			int m_stompPort;
@@ -54,9 +92,34 @@ namespace PyGoWave {
 			QMap<QByteArray,WaveModel*> m_allWaves;
 			QMap<QByteArray,Wavelet*> m_allWavelets;
 			QMap<QByteArray,Participant*> m_allParticipants;
+			QHash<QByteArray,Route> m_routes;
 			bool m_participantsTodoCollect;
 			QSet<QByteArray> m_participantsTodo;
 			QSet<QByteArray> m_openWavelets;
+			QSet<QByteArray> m_deferredOpens;
+			QSet<QByteArray> m_dormantWavelets;
+			QMap<QByteArray,quint64> m_lastViewed;
+			int m_idleUnsubscribeTimeout;
+
+			QString m_cacheDirectory;
+			int m_participantCacheTtl;
+			ParticipantCache m_participantCache;
+			QSet<QByteArray> m_participantsStale;
+			WaveCache m_waveCache;
+			QMap<QByteArray,int> m_cachedVersions;
+			int m_prefetchCount;
+			QList< QPair<QByteArray,int> > m_prefetchQueue;
+			QByteArray m_prefetching;
+
+			bool m_offlineEditing;
+			OperationJournal m_journal;
+			QSet<QByteArray> m_journalDirty;
+			bool m_journalHeld;
+			QMap<QByteArray,QVariantMap> m_inflight;
+			QSet<QByteArray> m_inflightCheck;
+			QMap<QByteArray,int> m_journalBase;
+			QMap<QByteArray,bool> m_resync;
+			QSet<QByteArray> m_resyncSnapshot;
 
 			QMap<QByteArray,OpManager*> mcached;
 			QMap<QByteArray,OpManager*> mpending;
@@ -64,39 +127,118 @@ namespace PyGoWave {
 			QMap<QByteArray,bool> ispending;
 
 			int m_lastSearchId;
+			int m_serverSearchId;
+			QString m_searchText;
+			QList<QByteArray> m_localResults;
+			ParticipantIndex m_participantIndex;
 			QByteArray m_createdWaveId;
 
 			QList< QHash<QString,QString> > m_cachedGadgetList;
 
+			int m_compressionThreshold;
+			bool m_peerAcceptsDeflate;
+
+			int m_keepAliveMinimum;
+			int m_keepAliveMaximum;
+			int m_keepAliveInterval;
+			Histogram m_keepAliveRoundTrip;
+			quint64 m_lastSent;
+
+			int m_updateInterval;
+			int m_updateLatencyCap;
+			quint64 m_inboundSince;
+			QMap< QByteArray, QList<QueuedBundle> > m_inbound;
+
+			ControllerMetrics m_metrics;
+			QMap<QByteArray,quint64> m_bundleSentAt;
+
+			FrameRecorder * m_recorder;
+			bool m_replay;
+			int m_droppedFrames;
+
 			void addWave(WaveModel * wave, bool initial);
+			void addWavelet(Wavelet * wavelet);
+			void updateWave(const QByteArray &waveId, const QVariantMap &wavelets, bool initial);
+			void loadCachedWaves();
+			void schedulePrefetch(const QVariantMap &waveList);
+			void showCachedSnapshot(const QByteArray &waveletId);
 			void removeWave(const QByteArray &id, bool deleteObjects);
 			void clearWaves(bool deleteObjects);
 
 			void sendJson(const QByteArray & dest, const QString &type, const QVariant &property = QVariant());
+			void processFrame(const QStompResponseFrame &frame);
+			QVariant parseFrameBody(const QStompResponseFrame &frame, bool * ok);
+			void processMessages(const QByteArray &destination, const QVariant &data, bool ok);
+			void beginReplay();
+			bool routeReplayedWavelet(const QByteArray &destination);
 			void subscribeWavelet(const QByteArray &id, bool open = true);
 			void unsubscribeWavelet(const QByteArray &id, bool close = true);
-			void processMessage(const QByteArray &waveletId, const QString &type, const QVariant &property = QVariant());
+			void processMessage(const Route &route, const QString &type, const QVariant &property = QVariant());
+
+			typedef void (ControllerPrivate::*ManagerHandler)(const QVariant &property);
+			typedef void (ControllerPrivate::*WaveletHandler)(Wavelet * wavelet, const QVariant &property);
+			static const QHash<QString,ManagerHandler> & managerHandlers();
+			static const QHash<QString,WaveletHandler> & waveletHandlers();
+
+			void handleWaveList(const QVariant &property);
+			void handleWaveletList(const QVariant &property);
+			void handleParticipantInfo(const QVariant &property);
+			void handlePong(const QVariant &property);
+			void handleParticipantSearch(const QVariant &property);
+			void handleWaveletAddParticipant(const QVariant &property);
+			void handleWaveletRemoveParticipant(const QVariant &property);
+			void handleWaveletCreated(const QVariant &property);
+			void handleGadgetList(const QVariant &property);
+			void handleWaveletOpen(Wavelet * wavelet, const QVariant &property);
+			void handleOperationMessageBundle(Wavelet * wavelet, const QVariant &property);
+			void handleOperationMessageBundleAck(Wavelet * wavelet, const QVariant &property);
 
 			Wavelet * newWaveletByDict(WaveModel * wave, const QByteArray &waveletId, const QVariantMap &waveletDict);
 			void updateWaveletByDict(Wavelet * wavelet, const QVariantMap &waveletDict);
 			void collectParticipants();
 			void retrieveParticipants();
 			void retrieveParticipant(const QByteArray & participant);
+			void loadCaches();
+			void saveCaches();
 			quint64 timestamp();
 			bool hasPendingOperations(const QByteArray &waveletId);
+			bool hasUnsentOperations(const QByteArray &waveletId);
 			void transferOperations(const QByteArray &waveletId);
-
-			void queueMessageBundle(Wavelet * wavelet, bool ack, const QVariant &serial_ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor);
+			void sendBundle(const QByteArray &waveletId, const QVariantMap &bundle);
+			bool checkInflight(Wavelet * wavelet, const QVariantMap &snapshot);
+			void resyncWavelet(const QByteArray &waveletId, bool open);
+			void finishResync(const QByteArray &waveletId);
+			void journalWavelet(const QByteArray &waveletId);
+			void restoreJournal();
+
+			void queueMessageBundle(Wavelet * wavelet, const QVariant &serial_ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor);
+			void flushInbound(const QByteArray &waveletId = QByteArray());
+			QList<Operation*> transformBundle(Wavelet * wavelet, const QVariant &serial_ops, const QByteArray &contributor);
+			void applyBundle(Wavelet * wavelet, QList<Operation*> ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor);
 			void processMessageBundle(Wavelet * wavelet, bool ack, const QVariant &serial_ops, int version, const QVariantMap &blipsums, const QDateTime &timestamp, const QByteArray &contributor);
 
+			void metricsChanged();
+
+			static QByteArray deflate(const QByteArray &data);
+			static QByteArray inflate(const QByteArray &data);
+
 			void _q_conn_socketConnected();
 			void _q_conn_socketDisconnected();
 			void _q_conn_frameReceived();
 			void _q_conn_socketStateChanged(QAbstractSocket::SocketState);
 			void _q_conn_socketError(QAbstractSocket::SocketError);
+			void _q_decoder_resultsReady();
 			void _q_pingTimer_timeout();
 			void _q_pendingTimer_timeout();
+			void _q_cacheTimer_timeout();
+			void _q_prefetchTimer_timeout();
+			void _q_idleTimer_timeout();
+			void _q_inboundTimer_timeout();
+			void _q_searchTimer_timeout();
+			void _q_metricsTimer_timeout();
+			void _q_emitLocalSearchResults();
 			void _q_mcached_afterOperationsInserted(int start, int end);
+			void _q_mcached_operationsChanged();
 			void _q_wavelet_participantsChanged();
 
 		private:
@@ -0,0 +1,200 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "framedecoder_p.h"
+#include "controller.h"
+#include "metrics.h"
+
+#include <qjson/parser.h>
+
+#include <QtCore/QRunnable>
+#include <QtCore/QMutexLocker>
+
+#include "controller_p.h"
+
+namespace PyGoWave {
+
+	class FrameDecoderTask : public QRunnable
+	{
+	public:
+		FrameDecoderTask(FrameDecoder * decoder, const QByteArray &destination)
+			: m_decoder(decoder), m_destination(destination) {}
+
+		void run()
+		{
+			QJson::Parser parser; // Parsers are not thread-safe
+			while (this->m_decoder->runNext(this->m_destination, &parser)) {}
+		}
+
+	private:
+		FrameDecoder * m_decoder;
+		QByteArray m_destination;
+	};
+}
+
+using namespace PyGoWave;
+
+/*!
+	\internal
+	\class PyGoWave::FrameDecoder
+	\brief Inflates and parses message frames on a thread pool.
+
+	Frames of the same destination are decoded one after another and their
+	results are delivered in the order they were enqueued; destinations do
+	not wait for each other. Barrier frames keep the order across
+	destinations: they are delivered after all earlier frames and before all
+	later ones. resultsReady() is emitted in the thread of the decoder once
+	for every batch of results.
+*/
+
+FrameDecoder::FrameDecoder(QObject * parent) : QObject(parent)
+{
+	this->m_barriers = 0;
+	this->m_nextSequence = 0;
+	this->m_notified = false;
+}
+
+FrameDecoder::~FrameDecoder()
+{
+	this->m_pool.waitForDone();
+}
+
+/*!
+	Returns true if a frame of \a destination must be enqueued to keep its
+	order, because earlier frames of the destination or a barrier frame have
+	not been taken yet. A \a barrier frame waits for the frames of all
+	destinations.
+*/
+bool FrameDecoder::isBusy(const QByteArray &destination, bool barrier) const
+{
+	QMutexLocker locker(&this->m_mutex);
+	if (barrier)
+		return !this->m_entries.isEmpty();
+	return this->m_barriers > 0 || this->m_outstanding.contains(destination);
+}
+
+/*!
+	Decodes a frame of \a destination in the background. A \a barrier frame is
+	delivered in order with the frames of all destinations.
+*/
+void FrameDecoder::enqueue(const QByteArray &destination, const QByteArray &body, bool deflated, bool barrier)
+{
+	Frame frame;
+	frame.destination = destination;
+	frame.body = body;
+	frame.deflated = deflated;
+
+	QMutexLocker locker(&this->m_mutex);
+	frame.sequence = this->m_nextSequence++;
+	Entry &entry = this->m_entries[frame.sequence];
+	entry.destination = destination;
+	entry.barrier = barrier;
+	entry.done = false;
+	this->m_outstanding[destination]++;
+	if (barrier)
+		this->m_barriers++;
+	QQueue<Frame> &queue = this->m_queues[destination];
+	bool idle = queue.isEmpty();
+	queue.enqueue(frame);
+	// An idle queue has no task; a busy one is drained by its running task
+	if (idle)
+		this->m_pool.start(new FrameDecoderTask(this, destination));
+}
+
+/*!
+	Returns the decoded results which are not held back by an earlier frame
+	of their destination or by a barrier frame, in the order they were
+	enqueued.
+*/
+QList<FrameDecoder::Result> FrameDecoder::takeResults()
+{
+	QMutexLocker locker(&this->m_mutex);
+	this->m_notified = false;
+	QList<Result> results;
+	QSet<QByteArray> blocked;
+	bool held = false;
+	QMap<quint64, Entry>::iterator it = this->m_entries.begin();
+	while (it != this->m_entries.end()) {
+		const Entry &entry = it.value();
+		const QByteArray &destination = entry.destination;
+		if (!entry.done || blocked.contains(destination) || (entry.barrier && held)) {
+			if (entry.barrier)
+				break; // Nothing later may overtake it
+			held = true;
+			blocked.insert(destination);
+			++it;
+			continue;
+		}
+		results.append(entry.result);
+		if (--this->m_outstanding[destination] <= 0)
+			this->m_outstanding.remove(destination);
+		if (entry.barrier)
+			this->m_barriers--;
+		it = this->m_entries.erase(it);
+	}
+	return results;
+}
+
+bool FrameDecoder::runNext(const QByteArray &destination, QJson::Parser * parser)
+{
+	this->m_mutex.lock();
+	Frame frame = this->m_queues[destination].head();
+	this->m_mutex.unlock();
+
+	Result result = FrameDecoder::decode(frame, parser);
+
+	QMutexLocker locker(&this->m_mutex);
+	QQueue<Frame> &queue = this->m_queues[destination];
+	queue.dequeue(); // Only dequeued when done, so enqueue() sees the task as running
+	Entry &entry = this->m_entries[frame.sequence];
+	entry.result = result;
+	entry.done = true;
+	if (!this->m_notified) {
+		this->m_notified = true;
+		QMetaObject::invokeMethod(this, "resultsReady", Qt::QueuedConnection);
+	}
+	if (queue.isEmpty()) {
+		this->m_queues.remove(destination);
+		return false;
+	}
+	return true;
+}
+
+/*!
+	Inflates the body of \a frame if necessary and parses it with \a parser.
+*/
+FrameDecoder::Result FrameDecoder::decode(const Frame &frame, QJson::Parser * parser)
+{
+	Result result;
+	result.destination = frame.destination;
+	result.ok = false;
+	result.parseTime = 0;
+	QByteArray body = frame.body;
+	if (frame.deflated) {
+		body = ControllerPrivate::inflate(body);
+		if (body.isEmpty())
+			return result;
+	}
+	quint64 start = monotonicMicroseconds();
+	result.data = parser->parse(body, &result.ok);
+	result.parseTime = monotonicMicroseconds() - start;
+	return result;
+}
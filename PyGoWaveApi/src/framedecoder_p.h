@@ -0,0 +1,98 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FRAMEDECODER_P_H
+#define FRAMEDECODER_P_H
+
+#include "pygowave_api_global.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+#include <QtCore/QVariant>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadPool>
+
+namespace QJson {
+	class Parser;
+}
+
+namespace PyGoWave {
+
+	class FrameDecoder : public QObject
+	{
+		Q_OBJECT
+
+	public:
+		struct Frame
+		{
+			QByteArray destination;
+			QByteArray body;
+			bool deflated;
+			quint64 sequence;
+		};
+
+		struct Result
+		{
+			QByteArray destination;
+			QVariant data;
+			bool ok;
+			quint64 parseTime;
+		};
+
+		FrameDecoder(QObject * parent = 0);
+		~FrameDecoder();
+
+		bool isBusy(const QByteArray &destination, bool barrier = false) const;
+		void enqueue(const QByteArray &destination, const QByteArray &body, bool deflated, bool barrier = false);
+		QList<Result> takeResults();
+
+		static Result decode(const Frame &frame, QJson::Parser * parser);
+
+	signals:
+		void resultsReady();
+
+	private:
+		struct Entry
+		{
+			QByteArray destination;
+			bool barrier;
+			bool done;
+			Result result;
+		};
+
+		friend class FrameDecoderTask;
+		bool runNext(const QByteArray &destination, QJson::Parser * parser);
+
+		mutable QMutex m_mutex;
+		QHash< QByteArray, QQueue<Frame> > m_queues;
+		QMap<quint64, Entry> m_entries; // Frames not taken yet, by sequence number
+		QHash<QByteArray,int> m_outstanding;
+		int m_barriers;
+		quint64 m_nextSequence;
+		bool m_notified;
+		QThreadPool m_pool;
+	};
+}
+
+#endif // FRAMEDECODER_P_H
@@ -0,0 +1,150 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gapbuffer_p.h"
+
+#include <string.h>
+
+using namespace PyGoWave;
+
+#define MIN_GAP 64
+
+/*!
+	\internal
+	\class PyGoWave::GapBuffer
+	\brief Text storage with a movable gap at the last edit position.
+
+	Inserting or removing text only moves the characters between the old
+	and the new edit position, so a series of edits near each other does
+	not copy the rest of the text each time. Indices are clamped to the
+	text, like QString::mid() does.
+*/
+
+GapBuffer::GapBuffer(const QString &text)
+{
+	this->setText(text);
+}
+
+int GapBuffer::length() const
+{
+	return this->m_buffer.size() - (this->m_gapEnd - this->m_gapStart);
+}
+
+bool GapBuffer::isEmpty() const
+{
+	return this->length() == 0;
+}
+
+QChar GapBuffer::at(int index) const
+{
+	if (index < this->m_gapStart)
+		return this->m_buffer.at(index);
+	return this->m_buffer.at(index + this->m_gapEnd - this->m_gapStart);
+}
+
+/*!
+	Returns \a length characters starting at \a index, or all remaining
+	characters if \a length is -1.
+*/
+QString GapBuffer::mid(int index, int length) const
+{
+	int size = this->length();
+	index = qBound(0, index, size);
+	if (length < 0 || length > size - index)
+		length = size - index;
+
+	// Both halves are contiguous, so this is at most two copies
+	if (index + length <= this->m_gapStart)
+		return this->m_buffer.mid(index, length);
+	int gap = this->m_gapEnd - this->m_gapStart;
+	if (index >= this->m_gapStart)
+		return this->m_buffer.mid(index + gap, length);
+	QString ret;
+	ret.reserve(length);
+	ret.append(this->m_buffer.constData() + index, this->m_gapStart - index);
+	ret.append(this->m_buffer.constData() + this->m_gapEnd, length - (this->m_gapStart - index));
+	return ret;
+}
+
+QString GapBuffer::toString() const
+{
+	return this->mid(0);
+}
+
+void GapBuffer::setText(const QString &text)
+{
+	this->m_buffer = text;
+	this->m_gapStart = this->m_gapEnd = text.size();
+}
+
+void GapBuffer::insert(int index, const QString &text)
+{
+	if (text.isEmpty())
+		return;
+	this->moveGap(qBound(0, index, this->length()));
+	this->reserveGap(text.size());
+	memcpy(this->m_buffer.data() + this->m_gapStart, text.constData(), text.size() * sizeof(QChar));
+	this->m_gapStart += text.size();
+}
+
+void GapBuffer::remove(int index, int length)
+{
+	int size = this->length();
+	if (index < 0 || index >= size || length <= 0)
+		return;
+	this->moveGap(index);
+	this->m_gapEnd += qMin(length, size - index);
+}
+
+void GapBuffer::moveGap(int index)
+{
+	if (index == this->m_gapStart)
+		return;
+	QChar * data = this->m_buffer.data();
+	if (index < this->m_gapStart) {
+		int count = this->m_gapStart - index;
+		memmove(data + this->m_gapEnd - count, data + index, count * sizeof(QChar));
+		this->m_gapStart -= count;
+		this->m_gapEnd -= count;
+	}
+	else {
+		int count = index - this->m_gapStart;
+		memmove(data + this->m_gapStart, data + this->m_gapEnd, count * sizeof(QChar));
+		this->m_gapStart += count;
+		this->m_gapEnd += count;
+	}
+}
+
+void GapBuffer::reserveGap(int length)
+{
+	int gap = this->m_gapEnd - this->m_gapStart;
+	if (gap >= length)
+		return;
+
+	// Grow by at least half of the text to keep appends amortized O(1)
+	int size = this->m_buffer.size();
+	int grow = qMax(length - gap, qMax(MIN_GAP, size / 2));
+	int tail = size - this->m_gapEnd;
+	this->m_buffer.resize(size + grow);
+	QChar * data = this->m_buffer.data();
+	memmove(data + this->m_gapEnd + grow, data + this->m_gapEnd, tail * sizeof(QChar));
+	this->m_gapEnd += grow;
+}
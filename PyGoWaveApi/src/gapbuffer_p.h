@@ -0,0 +1,57 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GAPBUFFER_P_H
+#define GAPBUFFER_P_H
+
+#include "pygowave_api_global.h"
+
+#include <QtCore/QString>
+
+namespace PyGoWave {
+
+	class GapBuffer
+	{
+	public:
+		GapBuffer(const QString &text = QString());
+
+		int length() const;
+		bool isEmpty() const;
+
+		QChar at(int index) const;
+		QString mid(int index, int length = -1) const;
+		QString toString() const;
+
+		void setText(const QString &text);
+		void insert(int index, const QString &text);
+		void remove(int index, int length);
+
+	private:
+		void moveGap(int index);
+		void reserveGap(int length);
+
+		QString m_buffer;
+		int m_gapStart;
+		int m_gapEnd;
+	};
+}
+
+#endif // GAPBUFFER_P_H
@@ -0,0 +1,273 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QDateTime>
+#include <QtCore/qmath.h>
+#if QT_VERSION >= 0x040800
+#  include <QtCore/QElapsedTimer>
+#  include <QtCore/QAtomicInt>
+#  include <QtCore/QThread>
+#endif
+
+using namespace PyGoWave;
+
+#if QT_VERSION >= 0x040800
+static QElapsedTimer monotonicClock;
+static QBasicAtomicInt monotonicClockState = Q_BASIC_ATOMIC_INITIALIZER(0); // Stopped, starting, running
+#endif
+
+/*!
+	\class PyGoWave::Histogram
+	\brief Rolling window of the most recent samples of a measurement.
+
+	Only the last \a capacity samples are kept; statistics are calculated
+	over this window.
+*/
+
+/*!
+	Constructs an empty Histogram holding up to \a capacity samples.
+*/
+Histogram::Histogram(int capacity)
+{
+	this->m_capacity = qMax(capacity, 1);
+	this->m_next = 0;
+	this->m_total = 0;
+}
+
+/*!
+	Adds a sample, replacing the oldest one if the window is full.
+*/
+void Histogram::addSample(double value)
+{
+	if (this->m_samples.size() < this->m_capacity)
+		this->m_samples.append(value);
+	else
+		this->m_samples[this->m_next] = value;
+	this->m_next = (this->m_next + 1) % this->m_capacity;
+	this->m_total++;
+}
+
+/*!
+	Removes all samples.
+*/
+void Histogram::clear()
+{
+	this->m_samples.clear();
+	this->m_next = 0;
+	this->m_total = 0;
+}
+
+/*!
+	Returns the number of samples in the window.
+*/
+int Histogram::count() const
+{
+	return this->m_samples.size();
+}
+
+/*!
+	Returns the number of samples ever added.
+*/
+quint64 Histogram::totalCount() const
+{
+	return this->m_total;
+}
+
+/*!
+	Returns the most recent sample or 0 if there is none.
+*/
+double Histogram::last() const
+{
+	if (this->m_samples.isEmpty())
+		return 0.0;
+	return this->m_samples.at((this->m_next + this->m_capacity - 1) % this->m_capacity);
+}
+
+double Histogram::minimum() const
+{
+	if (this->m_samples.isEmpty())
+		return 0.0;
+	double ret = this->m_samples.at(0);
+	foreach (double v, this->m_samples)
+		ret = qMin(ret, v);
+	return ret;
+}
+
+double Histogram::maximum() const
+{
+	if (this->m_samples.isEmpty())
+		return 0.0;
+	double ret = this->m_samples.at(0);
+	foreach (double v, this->m_samples)
+		ret = qMax(ret, v);
+	return ret;
+}
+
+double Histogram::mean() const
+{
+	if (this->m_samples.isEmpty())
+		return 0.0;
+	double sum = 0.0;
+	foreach (double v, this->m_samples)
+		sum += v;
+	return sum / this->m_samples.size();
+}
+
+/*!
+	Returns the population standard deviation of the samples in the window.
+*/
+double Histogram::standardDeviation() const
+{
+	if (this->m_samples.isEmpty())
+		return 0.0;
+	double m = this->mean();
+	double sum = 0.0;
+	foreach (double v, this->m_samples)
+		sum += (v - m) * (v - m);
+	return qSqrt(sum / this->m_samples.size());
+}
+
+/*!
+	Returns the \a p-th percentile (0-100) of the samples in the window
+	(nearest rank).
+*/
+double Histogram::percentile(double p) const
+{
+	if (this->m_samples.isEmpty())
+		return 0.0;
+	QVector<double> sorted = this->m_samples;
+	qSort(sorted);
+	int rank = (int) (p / 100.0 * sorted.size() + 0.5) - 1;
+	return sorted.at(qBound(0, rank, sorted.size() - 1));
+}
+
+/*!
+	Returns the samples in the window in no particular order.
+*/
+QVector<double> Histogram::samples() const
+{
+	return this->m_samples;
+}
+
+
+/*!
+	\class PyGoWave::RateMeter
+	\brief Counts events per second over a sliding window of whole seconds.
+*/
+
+RateMeter::RateMeter(int windowSeconds)
+{
+	this->m_buckets.fill(0, qMax(windowSeconds, 1));
+	this->m_second = monotonicMicroseconds() / 1000000;
+	this->m_total = 0;
+}
+
+/*!
+	Registers \a count events at the current time.
+*/
+void RateMeter::tick(int count)
+{
+	qint64 second = monotonicMicroseconds() / 1000000;
+	this->advance(second);
+	this->m_buckets[second % this->m_buckets.size()] += count;
+	this->m_total += count;
+}
+
+void RateMeter::clear()
+{
+	this->m_buckets.fill(0);
+	this->m_total = 0;
+}
+
+/*!
+	Returns the average number of events per second within the window.
+*/
+double RateMeter::rate() const
+{
+	this->advance(monotonicMicroseconds() / 1000000);
+	int sum = 0;
+	foreach (int c, this->m_buckets)
+		sum += c;
+	return (double) sum / this->m_buckets.size();
+}
+
+/*!
+	Returns the number of events ever registered.
+*/
+quint64 RateMeter::totalCount() const
+{
+	return this->m_total;
+}
+
+void RateMeter::advance(qint64 second) const
+{
+	// Clear the buckets of all seconds which passed without events
+	int size = this->m_buckets.size();
+	for (qint64 s = this->m_second + 1; s <= second && s - this->m_second <= size; s++)
+		this->m_buckets[s % size] = 0;
+	if (second > this->m_second)
+		this->m_second = second;
+}
+
+
+/*!
+	\class PyGoWave::ControllerMetrics
+	\brief Latency and throughput measurements of a Controller.
+
+	Latencies are given in milliseconds, parse times in microseconds.
+	The latencies of a wavelet are dropped when it is unsubscribed or
+	removed.
+
+	\sa Controller::metrics()
+*/
+
+ControllerMetrics::ControllerMetrics()
+{
+	this->bytesIn = 0;
+	this->bytesOut = 0;
+}
+
+/*!
+	Returns a monotonic timestamp in microseconds, suitable for measuring
+	time differences. The clock starts on the first call, which may come
+	from any thread.
+*/
+quint64 PyGoWave::monotonicMicroseconds()
+{
+#if QT_VERSION >= 0x040800
+	if (!monotonicClockState.testAndSetAcquire(2, 2)) {
+		if (monotonicClockState.testAndSetOrdered(0, 1)) {
+			monotonicClock.start();
+			monotonicClockState.fetchAndStoreRelease(2);
+		}
+		else {
+			while (!monotonicClockState.testAndSetAcquire(2, 2))
+				QThread::yieldCurrentThread(); // Another thread is starting it
+		}
+	}
+	return monotonicClock.nsecsElapsed() / 1000llu;
+#else
+	QDateTime now = QDateTime::currentDateTime().toUTC();
+	return (now.toTime_t() * 1000llu + now.time().msec()) * 1000llu;
+#endif
+}
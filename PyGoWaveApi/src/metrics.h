@@ -0,0 +1,95 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "pygowave_api_global.h"
+
+#include <QtCore/QVector>
+#include <QtCore/QMap>
+#include <QtCore/QByteArray>
+
+namespace PyGoWave {
+
+	class PYGOWAVE_API_SHARED_EXPORT Histogram
+	{
+	public:
+		Histogram(int capacity = 256);
+
+		void addSample(double value);
+		void clear();
+
+		int count() const;
+		quint64 totalCount() const;
+
+		double last() const;
+		double minimum() const;
+		double maximum() const;
+		double mean() const;
+		double standardDeviation() const;
+		double percentile(double p) const;
+
+		QVector<double> samples() const;
+
+	private:
+		QVector<double> m_samples;
+		int m_capacity;
+		int m_next;
+		quint64 m_total;
+	};
+
+	class PYGOWAVE_API_SHARED_EXPORT RateMeter
+	{
+	public:
+		RateMeter(int windowSeconds = 10);
+
+		void tick(int count = 1);
+		void clear();
+
+		double rate() const;
+		quint64 totalCount() const;
+
+	private:
+		void advance(qint64 second) const;
+
+		mutable QVector<int> m_buckets;
+		mutable qint64 m_second;
+		quint64 m_total;
+	};
+
+	class PYGOWAVE_API_SHARED_EXPORT ControllerMetrics
+	{
+	public:
+		ControllerMetrics();
+
+		Histogram pingRoundTrip;
+		Histogram ackLatency;
+		QMap<QByteArray, Histogram> waveletAckLatency;
+		Histogram jsonParseTime;
+		RateMeter inboundBundles;
+		quint64 bytesIn;
+		quint64 bytesOut;
+	};
+
+	quint64 PYGOWAVE_API_SHARED_EXPORT monotonicMicroseconds();
+}
+
+#endif // METRICS_H
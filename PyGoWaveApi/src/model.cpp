@@ -23,9 +23,14 @@
 #include "operations.h"
 
 #include <QtCore/QCryptographicHash>
+#include <QtCore/QSet>
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QtConcurrentMap>
 
 using namespace PyGoWave;
 
+#define SNAPSHOT_CHUNK_SIZE 64
+
 /*!
 	\class PyGoWave::Participant
 	\brief Models a participant to a Wavelet.
@@ -483,6 +488,7 @@ Wavelet::Wavelet(
 	d->m_version = version;
 	d->m_rootBlip = NULL;
 	d->m_status = "clean";
+	d->m_changeDepth = 0;
 
 	if (isRoot) {
 		if (wave->rootWavelet() == NULL)
@@ -708,8 +714,14 @@ Blip * Wavelet::insertBlip(
 {
 	P_D(Wavelet);
 	Blip * blip = new Blip(this, id, content, elements, NULL, creator, contributors, isRoot, lastModified, version, submitted);
-	d->m_blips.insert(index, blip);
-	emit blipInserted(index, blip->id());
+	BlipSlot slot;
+	slot.m_blip = blip;
+	slot.m_id = blip->id();
+	slot.m_root = isRoot;
+	index = qBound(0, index, d->m_blips.size());
+	d->m_blips.shift(index, 1);
+	d->m_blipsById.insert(slot.m_id, d->m_blips.insert(index, slot));
+	emit blipInserted(index, slot.m_id);
 	return blip;
 }
 
@@ -721,14 +733,14 @@ Blip * Wavelet::insertBlip(
 void Wavelet::deleteBlip(const QByteArray & id)
 {
 	P_D(Wavelet);
-	for (int i = 0; i < d->m_blips.size(); i++) {
-		Blip * blip = d->m_blips[i];
-		if (blip->id() == id) {
-			d->m_blips.removeAt(i);
-			delete blip;
-			emit blipDeleted(id);
-			break;
-		}
+	WaveletPrivate::BlipNode * node = d->m_blipsById.take(id);
+	if (node != NULL) {
+		Blip * blip = node->value.m_blip;
+		int index = OffsetTree<BlipSlot>::position(node);
+		d->m_blips.erase(node);
+		d->m_blips.shift(index, -1);
+		delete blip;
+		emit blipDeleted(id);
 	}
 }
 
@@ -738,9 +750,8 @@ void Wavelet::deleteBlip(const QByteArray & id)
 Blip * Wavelet::blipByIndex(int index) const
 {
 	const P_D(Wavelet);
-	if (index < 0 || index >= d->m_blips.size())
-		return NULL;
-	return d->m_blips.at(index);
+	WaveletPrivate::BlipNode * node = d->m_blips.find(index);
+	return d->materializeBlip(const_cast<Wavelet*>(this), node);
 }
 
 /*!
@@ -750,11 +761,8 @@ Blip * Wavelet::blipByIndex(int index) const
 Blip * Wavelet::blipById(const QByteArray & id) const
 {
 	const P_D(Wavelet);
-	foreach (Blip * blip, d->m_blips) {
-		if (blip->id() == id)
-			return blip;
-	}
-	return NULL;
+	WaveletPrivate::BlipNode * node = d->m_blipsById.value(id);
+	return d->materializeBlip(const_cast<Wavelet*>(this), node);
 }
 
 /*!
@@ -763,7 +771,10 @@ Blip * Wavelet::blipById(const QByteArray & id) const
 QList<Blip*> Wavelet::allBlips() const
 {
 	const P_D(Wavelet);
-	return d->m_blips;
+	QList<Blip*> blips;
+	foreach (WaveletPrivate::BlipNode * node, d->m_blips.nodes())
+		blips.append(d->materializeBlip(const_cast<Wavelet*>(this), node));
+	return blips;
 }
 
 /*!
@@ -774,8 +785,8 @@ QList<QByteArray> Wavelet::allBlipIDs() const
 {
 	const P_D(Wavelet);
 	QList<QByteArray> ids;
-	foreach (Blip * blip, d->m_blips)
-		ids.append(blip->id());
+	foreach (BlipSlot slot, d->m_blips.values())
+		ids.append(slot.m_id);
 	return ids;
 }
 
@@ -788,6 +799,180 @@ void WaveletPrivate::setRootBlip(Blip * blip)
 	this->m_rootBlip = blip;
 }
 
+/*!
+	\internal
+	Returns the Blip of a \a node, creating it from its snapshot record on
+	first access.
+*/
+Blip * WaveletPrivate::materializeBlip(Wavelet * wavelet, BlipNode * node) const
+{
+	if (node == NULL)
+		return NULL;
+	BlipSlot &slot = node->value;
+	if (slot.m_blip != NULL)
+		return slot.m_blip;
+
+	IParticipantProvider * pp = this->m_wave->participantProvider();
+	const BlipRecord &record = slot.m_record;
+
+	QList<Participant*> contributors;
+	foreach (QByteArray cid, record.m_contributors)
+		contributors.append(pp->participant(cid));
+
+	slot.m_blip = new Blip(
+			wavelet,
+			slot.m_id,
+			record.m_content,
+			QList<Element*>(),
+			NULL,
+			pp->participant(record.m_creator),
+			contributors,
+			slot.m_root,
+			record.m_lastModified,
+			record.m_version,
+			record.m_submitted
+		);
+	// Elements stay plain records until someone asks for them
+	BlipPrivate * bd = slot.m_blip->pd_func();
+	foreach (const ElementRecord &element, record.m_elements)
+		bd->insertElement(element.m_index, element);
+	slot.m_record = BlipRecord();
+	return slot.m_blip;
+}
+
+/*!
+	\internal
+	\class PyGoWave::BlipRecord
+	\brief Plain data of a Blip from a snapshot, which can be prepared on
+	any thread.
+*/
+
+/*!
+	\internal
+	Converts the snapshot data of the blip \a id.
+*/
+BlipRecord BlipRecord::fromSnapshot(const QByteArray &id, const QVariantMap &blip)
+{
+	BlipRecord record;
+	record.m_id = id;
+	record.m_creationTime = blip["creationTime"].toULongLong();
+	record.m_content = blip["content"].toString();
+	foreach (QVariant element, blip["elements"].toList()) {
+		QVariantMap melement = element.toMap();
+		ElementRecord erecord;
+		erecord.m_id = melement["id"].toInt();
+		erecord.m_index = melement["index"].toInt();
+		erecord.m_type = (Element::Type) melement["type"].toInt();
+		erecord.m_properties = melement["properties"].toMap();
+		erecord.m_facade = NULL;
+		record.m_elements.append(erecord);
+	}
+	record.m_creator = blip["creator"].toByteArray();
+	foreach (QVariant v_cid, blip["contributors"].toList())
+		record.m_contributors.append(v_cid.toByteArray());
+	record.m_lastModified = parseTimestamp(blip["lastModifiedTime"]);
+	record.m_version = blip["version"].toInt();
+	record.m_submitted = blip["submitted"].toBool();
+	return record;
+}
+
+typedef QList< QPair<QByteArray, QVariant> > SnapshotChunk;
+
+static QList<BlipRecord> prepareSnapshotChunk(const SnapshotChunk &chunk)
+{
+	QList<BlipRecord> records;
+	for (int i = 0; i < chunk.size(); i++)
+		records.append(BlipRecord::fromSnapshot(chunk.at(i).first, chunk.at(i).second.toMap()));
+	return records;
+}
+
+static void joinSnapshotChunks(QList<BlipRecord> &records, const QList<BlipRecord> &chunk)
+{
+	records += chunk;
+}
+
+/*!
+	\internal
+	Converts the snapshot data of all \a blips and sorts them by creation
+	time. Large snapshots are converted in chunks on the global thread pool.
+*/
+QList<BlipRecord> BlipRecord::fromSnapshot(const QVariantMap &blips)
+{
+	QList<SnapshotChunk> chunks;
+	SnapshotChunk chunk;
+	for (QVariantMap::const_iterator it = blips.constBegin(); it != blips.constEnd(); ++it) {
+		chunk.append(qMakePair(it.key().toAscii(), it.value()));
+		if (chunk.size() == SNAPSHOT_CHUNK_SIZE) {
+			chunks.append(chunk);
+			chunk.clear();
+		}
+	}
+	if (!chunk.isEmpty())
+		chunks.append(chunk);
+
+	QList<BlipRecord> records;
+	if (chunks.size() > 1)
+		records = QtConcurrent::blockingMappedReduced< QList<BlipRecord> >(chunks, prepareSnapshotChunk, joinSnapshotChunks, QtConcurrent::UnorderedReduce);
+	else if (!chunks.isEmpty())
+		records = prepareSnapshotChunk(chunks.first());
+
+	qSort(records.begin(), records.end(), BlipRecord::createdBefore);
+	return records;
+}
+
+/*!
+	\internal
+	Orders element records by their position.
+*/
+bool ElementRecord::indexBefore(const ElementRecord &a, const ElementRecord &b)
+{
+	return a.m_index < b.m_index;
+}
+
+/*!
+	\internal
+	Merges a gadget state \a delta into the "fields" of \a properties; null
+	values remove a field.
+*/
+void ElementRecord::applyDelta(QVariantMap &properties, const QVariantMap &delta)
+{
+	QVariantMap fields = properties.value("fields").toMap();
+
+	foreach (QString key, delta.keys()) {
+		QVariant data = delta[key];
+		if (data.isNull()) {
+			if (fields.contains(key))
+				fields.remove(key);
+		}
+		else
+			fields[key] = data;
+	}
+
+	properties["fields"] = fields;
+}
+
+/*!
+	\internal
+	Sets the UserPref \a key to \a value in \a properties.
+*/
+void ElementRecord::setUserPref(QVariantMap &properties, const QString &key, const QString &value)
+{
+	QVariantMap userprefs = properties.value("userprefs").toMap();
+	userprefs[key] = value;
+	properties["userprefs"] = userprefs;
+}
+
+/*!
+	\internal
+	Orders by creation time; the ID breaks ties to keep the order stable.
+*/
+bool BlipRecord::createdBefore(const BlipRecord &a, const BlipRecord &b)
+{
+	if (a.m_creationTime != b.m_creationTime)
+		return a.m_creationTime < b.m_creationTime;
+	return a.m_id < b.m_id;
+}
+
 /*!
 	\property Wavelet::status
 	\brief the status of this Wavelet
@@ -836,6 +1021,41 @@ void Wavelet::setLastModified(const QDateTime &value)
 	}
 }
 
+/*!
+	Starts collecting the changes of this Wavelet's Blips. Until the
+	matching endChanges(), each Blip emits \link Blip::changesApplied \endlink
+	only once with all its changes. Calls may be nested.
+
+	Element insertions and deletions are still delivered immediately,
+	together with the changes before them, so that listeners see the
+	element at the signalled position.
+*/
+void Wavelet::beginChanges()
+{
+	P_D(Wavelet);
+	d->m_changeDepth++;
+}
+
+/*!
+	Ends collecting changes. The outermost call lets every changed Blip
+	emit \link Blip::changesApplied \endlink.
+
+	\sa beginChanges
+*/
+void Wavelet::endChanges()
+{
+	P_D(Wavelet);
+	Q_ASSERT(d->m_changeDepth > 0);
+	if (--d->m_changeDepth > 0)
+		return;
+	QList< QPointer<Blip> > blips = d->m_changedBlips;
+	d->m_changedBlips.clear();
+	foreach (QPointer<Blip> blip, blips) {
+		if (!blip.isNull())
+			blip->flushChanges();
+	}
+}
+
 /*!
 	Calculate and compare checksums of all Blips to the given map.
 
@@ -843,11 +1063,17 @@ void Wavelet::setLastModified(const QDateTime &value)
 */
 void Wavelet::checkSync(const QMap<QByteArray, QByteArray> & blipsums)
 {
+	P_D(Wavelet);
 	bool valid = true;
 
 	foreach (QByteArray blipId, blipsums.keys()) {
-		Blip * blip = this->blipById(blipId);
-		if (blip != NULL && !blip->checkSync(blipsums[blipId]))
+		WaveletPrivate::BlipNode * node = d->m_blipsById.value(blipId);
+		if (node == NULL)
+			continue;
+		// Blips which were not accessed yet are checked against their snapshot text
+		if (node->value.m_blip == NULL && BlipPrivate::checksum(node->value.m_record.m_content) == blipsums[blipId])
+			continue;
+		if (!d->materializeBlip(this, node)->checkSync(blipsums[blipId]))
 			valid = false;
 	}
 
@@ -870,6 +1096,7 @@ void Wavelet::applyOperations(
 	IParticipantProvider * pp = d->m_wave->participantProvider();
 	Participant * contributor = pp->participant(contributorId);
 
+	this->beginChanges();
 	foreach (Operation * op, operations) {
 		QVariantMap property;
 		if (op->blipId() != "") {
@@ -922,6 +1149,7 @@ void Wavelet::applyOperations(
 			}
 		}
 	}
+	this->endChanges();
 
 	this->setLastModified(timestamp);
 }
@@ -937,64 +1165,78 @@ void Wavelet::updateBlipId(const QByteArray &tempId, const QByteArray &blipId)
 }
 
 /*!
-	Load the Blips from a snapshot. Removes previously existing Blips first.
+	Load the Blips from a snapshot.
+
+	The snapshot is compared with the existing Blips by their IDs: Blips
+	which are gone are deleted, new ones are inserted and existing ones are
+	updated in place, emitting signals only for what changed. Blips which
+	went out of sync are deleted and inserted again, so views show them
+	afresh. The changes of each Blip are reported together, see
+	beginChanges().
+
+	The Blip objects of new Blips are created on first access; until then
+	only their snapshot records are kept. allBlipIDs() does not create them.
 */
 void Wavelet::loadBlipsFromSnapshot(const QVariantMap &blips, const QByteArray &rootBlipId)
 {
-	const P_D(Wavelet);
+	P_D(Wavelet);
 	IParticipantProvider * pp = d->m_wave->participantProvider();
 
-	// Remove existing
-	while (!d->m_blips.isEmpty())
-		this->deleteBlip(d->m_blips.last()->id());
+	// Sorted by creation time
+	QList<BlipRecord> records = BlipRecord::fromSnapshot(blips);
 
-	// Ordering
-	QMap<quint64, QByteArray> created;
-	foreach (QString s_blip_id, blips.keys()) {
-		QByteArray blip_id = s_blip_id.toAscii();
-		created.insert(blips[blip_id].toMap()["creationTime"].toULongLong(), blip_id);
+	// Remove the Blips which are not in the snapshot
+	QSet<QByteArray> ids;
+	foreach (const BlipRecord &record, records)
+		ids.insert(record.m_id);
+	foreach (QByteArray id, this->allBlipIDs()) {
+		if (!ids.contains(id))
+			this->deleteBlip(id);
 	}
 
-	// Note: QMap is always sorted by key
-	foreach (QByteArray blip_id, created.values()) {
-		QVariantMap blip = blips[blip_id].toMap();
-		QList<Participant*> contributors;
-		foreach (QVariant v_cid, blip["contributors"].toList())
-			contributors.append(pp->participant(v_cid.toByteArray()));
-
-		QList<Element*> blip_elements;
-		foreach (QVariant element, blip["elements"].toList()) {
-			QVariantMap melement = element.toMap();
-			QVariantMap properties = melement["properties"].toMap();
-			if (melement["type"].toInt() == Element::GADGET)
-				blip_elements.append(new GadgetElement(
-						NULL,
-						melement["id"].toInt(),
-						melement["index"].toInt(),
-						properties
-					));
-			else
-				blip_elements.append(new Element(
-						NULL,
-						melement["id"].toInt(),
-						melement["index"].toInt(),
-						(Element::Type) melement["type"].toInt(),
-						properties
-					));
+	this->beginChanges();
+	for (int index = 0; index < records.size(); index++) {
+		const BlipRecord &record = records.at(index);
+		WaveletPrivate::BlipNode * node = d->m_blipsById.value(record.m_id);
+		bool placed = false;
+		BlipSlot slot;
+		slot.m_blip = NULL;
+		if (node != NULL) {
+			int current = OffsetTree<BlipSlot>::position(node);
+			Blip * blip = node->value.m_blip;
+			if (current != index || (blip != NULL && blip->pd_func()->m_outofsync)) {
+				// Moved, or out of sync and shown broken, so it is placed anew.
+				// All Blips before index are in place already, so current >= index
+				slot = node->value;
+				d->m_blipsById.remove(record.m_id);
+				d->m_blips.erase(node);
+				d->m_blips.shift(current, -1);
+				emit blipDeleted(record.m_id);
+				node = NULL;
+			}
+		}
+		if (node == NULL) {
+			slot.m_id = record.m_id;
+			d->m_blips.shift(index, 1);
+			node = d->m_blips.insert(index, slot);
+			d->m_blipsById.insert(record.m_id, node);
+			placed = true;
+		}
+
+		if (node->value.m_blip == NULL) {
+			node->value.m_record = record;
+			node->value.m_root = (record.m_id == rootBlipId);
+		}
+		else {
+			node->value.m_blip->loadRecord(record, pp);
+			if (placed) // Listeners of blipInserted() read the new state
+				node->value.m_blip->flushChanges();
 		}
 
-		this->appendBlip(
-				blip_id,
-				blip["content"].toString(),
-				blip_elements,
-				pp->participant(blip["creator"].toByteArray()),
-				contributors,
-				blip_id == rootBlipId,
-				parseTimestamp(blip["lastModifiedTime"]),
-				blip["version"].toInt(),
-				blip["submitted"].toBool()
-			);
+		if (placed)
+			emit blipInserted(index, record.m_id);
 	}
+	this->endChanges();
 }
 
 
@@ -1054,6 +1296,17 @@ void Wavelet::loadBlipsFromSnapshot(const QVariantMap &blips, const QByteArray &
 	Fired when a new contributor has been added.
 */
 
+/*!
+	\fn Blip::changesApplied(const QVariantList &changes)
+
+	Fired in addition to the signals above with the same \a changes as
+	maps, each with a "type" entry named after the signal and the
+	signal's arguments ("index", "text", "length", "id", "datetime").
+	Between Wavelet::beginChanges() and Wavelet::endChanges() the changes
+	are collected and adjacent text changes are merged, so this is usually
+	fired only once per Blip.
+*/
+
 /*!
 	Creates a new Blip object.
 
@@ -1093,10 +1346,13 @@ Blip::Blip(
 	else
 		d->m_id = id;
 	d->m_parent = parent;
+	d->m_text.setText(content);
 	d->m_content = content;
-	d->m_elements = elements;
-	foreach (Element * element, elements)
+	d->m_contentValid = true;
+	foreach (Element * element, elements) {
 		element->setBlip(this);
+		d->adoptElement(element, element->pd_func());
+	}
 	d->m_creator = creator;
 	foreach (Participant * c, contributors)
 		d->m_contributors.insert(c->id(), c);
@@ -1114,6 +1370,12 @@ Blip::Blip(
 */
 Blip::~Blip()
 {
+	P_D(Blip);
+	// Element objects are deleted as children after the element tree is gone
+	foreach (BlipPrivate::ElementNode * node, d->m_elements.nodes()) {
+		if (node->value.m_facade != NULL)
+			d->releaseElement(node);
+	}
 	delete this->pd_ptr;
 }
 
@@ -1136,6 +1398,12 @@ void Blip::setId(const QByteArray &id)
 	if (d->m_id != id) {
 		QByteArray oldId = d->m_id;
 		d->m_id = id;
+		QHash<QByteArray, WaveletPrivate::BlipNode*> &blipsById = d->m_wavelet->pd_func()->m_blipsById;
+		if (blipsById.contains(oldId)) {
+			WaveletPrivate::BlipNode * node = blipsById.take(oldId);
+			node->value.m_id = id;
+			blipsById.insert(id, node);
+		}
 		emit idChanged(oldId, id);
 	}
 }
@@ -1165,11 +1433,7 @@ bool Blip::isRoot() const
 Element * Blip::elementById(int id) const
 {
 	const P_D(Blip);
-	foreach (Element * element, d->m_elements) {
-		if (element->id() == id)
-			return element;
-	}
-	return NULL;
+	return d->facade(const_cast<Blip*>(this), d->m_elementsById.value(id));
 }
 
 /*!
@@ -1178,11 +1442,7 @@ Element * Blip::elementById(int id) const
 Element * Blip::elementAt(int index) const
 {
 	const P_D(Blip);
-	foreach (Element * element, d->m_elements) {
-		if (element->position() == index)
-			return element;
-	}
-	return NULL;
+	return d->facade(const_cast<Blip*>(this), d->m_elements.find(index));
 }
 
 /*!
@@ -1191,21 +1451,59 @@ Element * Blip::elementAt(int index) const
 QList<Element*> Blip::elementsWithin(int start, int end) const
 {
 	const P_D(Blip);
-	QList<Element*> lst;
-	foreach (Element * element, d->m_elements) {
-		if (element->position() >= start && element->position() < end)
-			lst.append(element);
-	}
-	return lst;
+	QList<Element*> ret;
+	foreach (BlipPrivate::ElementNode * node, d->m_elements.nodesWithin(start, end))
+		ret.append(d->facade(const_cast<Blip*>(this), node));
+	return ret;
 }
 
 /*!
-	Returns all Elements of this Blip.
+	Returns all Elements of this Blip ordered by position.
 */
 QList<Element*> Blip::allElements() const
 {
 	const P_D(Blip);
-	return d->m_elements;
+	QList<Element*> ret;
+	foreach (BlipPrivate::ElementNode * node, d->m_elements.nodes())
+		ret.append(d->facade(const_cast<Blip*>(this), node));
+	return ret;
+}
+
+/*!
+	Returns the IDs of the Elements between the \a start and \a end index.
+	Unlike elementsWithin(), this does not create Element objects.
+*/
+QList<int> Blip::elementIdsWithin(int start, int end) const
+{
+	const P_D(Blip);
+	QList<int> ret;
+	foreach (BlipPrivate::ElementNode * node, d->m_elements.nodesWithin(start, end))
+		ret.append(node->value.m_id);
+	return ret;
+}
+
+/*!
+	Returns the IDs of all Elements ordered by position without creating
+	Element objects.
+*/
+QList<int> Blip::allElementIds() const
+{
+	const P_D(Blip);
+	QList<int> ret;
+	foreach (BlipPrivate::ElementNode * node, d->m_elements.nodes())
+		ret.append(node->value.m_id);
+	return ret;
+}
+
+/*!
+	Returns the type of the Element with the given \a id or
+	Element::NOTHING if there is none.
+*/
+Element::Type Blip::elementTypeById(int id) const
+{
+	const P_D(Blip);
+	BlipPrivate::ElementNode * node = d->m_elementsById.value(id);
+	return node != NULL ? node->value.m_type : Element::NOTHING;
 }
 
 /*!
@@ -1226,6 +1524,9 @@ void Blip::addContributor(Participant * contributor)
 	if (!d->m_contributors.contains(contributor->id())) {
 		d->m_contributors.insert(contributor->id(), contributor);
 		emit contributorAdded(contributor->id());
+		QVariantMap change = BlipPrivate::change("contributorAdded");
+		change["id"] = QString::fromAscii(contributor->id());
+		this->notifyChange(change);
 	}
 }
 
@@ -1242,25 +1543,15 @@ void Blip::insertText(int index, const QString & text, Participant * contributor
 
 	this->addContributor(contributor);
 
-	d->m_content.insert(index, text);
-
-	int length = text.length();
-
-	foreach (Element * element, d->m_elements) {
-		if (element->position() >= index)
-			element->setPosition(element->position() + length);
-	}
-
-	foreach (Annotation * anno, d->m_annotations) {
-		if (anno->start() >= index) {
-			anno->setStart(anno->start() + length);
-			anno->setEnd(anno->end() + length);
-		}
-	}
+	d->insertText(index, text);
 
 	d->m_wavelet->setStatus("dirty");
-	if (!noevent)
+	if (!noevent) {
 		emit insertedText(index, QString(text));
+		QVariantMap change = BlipPrivate::change("insertedText", index);
+		change["text"] = text;
+		this->notifyChange(change);
+	}
 }
 
 /*!
@@ -1276,23 +1567,15 @@ void Blip::deleteText(int index, int length, Participant * contributor, bool noe
 
 	this->addContributor(contributor);
 
-	d->m_content.remove(index, length);
-
-	foreach (Element * element, d->m_elements) {
-		if (element->position() >= index)
-			element->setPosition(element->position() - length);
-	}
-
-	foreach (Annotation * anno, d->m_annotations) {
-		if (anno->start() >= index) {
-			anno->setStart(anno->start() - length);
-			anno->setEnd(anno->end() - length);
-		}
-	}
+	d->deleteText(index, length);
 
 	d->m_wavelet->setStatus("dirty");
-	if (!noevent)
+	if (!noevent) {
 		emit deletedText(index, length);
+		QVariantMap change = BlipPrivate::change("deletedText", index);
+		change["length"] = length;
+		this->notifyChange(change);
+	}
 }
 
 /*!
@@ -1310,16 +1593,18 @@ void Blip::insertElement(int index, Element::Type type, const QVariantMap & prop
 
 	this->insertText(index, "\n", contributor, true);
 
-	Element * elt;
-	if (type == Element::GADGET)
-		elt = new GadgetElement(this, -1, index, properties);
-	else
-		elt = new Element(this, -1, index, type, properties);
-	d->m_elements.append(elt);
+	ElementRecord record;
+	record.m_id = ElementPrivate::newTempId();
+	record.m_index = index;
+	record.m_type = type;
+	record.m_properties = properties;
+	d->insertElement(index, record);
 
 	d->m_wavelet->setStatus("dirty");
-	if (!noevent)
+	if (!noevent) {
 		emit insertedElement(index);
+		this->notifyChange(BlipPrivate::change("insertedElement", index), true);
+	}
 }
 
 /*!
@@ -1335,16 +1620,15 @@ void Blip::deleteElement(int index, Participant * contributor, bool noevent)
 
 	this->addContributor(contributor);
 
-	for (int i = 0; i < d->m_elements.length(); i++) {
-		Element * elt = d->m_elements.at(i);
-		if (elt->position() == index) {
-			d->m_elements.takeAt(i);
-			this->deleteText(index, 1, contributor, true);
-			if (!noevent)
-				emit deletedElement(index);
-			delete elt;
-			break;
+	BlipPrivate::ElementNode * node = d->m_elements.find(index);
+	if (node != NULL) {
+		Element * elt = d->releaseElement(node);
+		this->deleteText(index, 1, contributor, true);
+		if (!noevent) {
+			emit deletedElement(index);
+			this->notifyChange(BlipPrivate::change("deletedElement", index), true);
 		}
+		delete elt;
 	}
 }
 
@@ -1356,11 +1640,17 @@ void Blip::deleteElement(int index, Participant * contributor, bool noevent)
 */
 void Blip::applyElementDelta(int index, const QVariantMap & delta, Participant * contributor)
 {
+	P_D(Blip);
 	this->addContributor(contributor);
 
-	GadgetElement * elt = qobject_cast<GadgetElement*>(this->elementAt(index));
+	BlipPrivate::ElementNode * node = d->m_elements.find(index);
+	if (node == NULL || node->value.m_type != Element::GADGET)
+		return;
+	GadgetElement * elt = qobject_cast<GadgetElement*>(node->value.m_facade);
 	if (elt != NULL)
 		elt->applyDelta(delta);
+	else
+		ElementRecord::applyDelta(node->value.m_properties, delta);
 }
 
 /*!
@@ -1371,23 +1661,113 @@ void Blip::applyElementDelta(int index, const QVariantMap & delta, Participant *
 */
 void Blip::setElementUserpref(int index, const QString & key, const QString & value, Participant * contributor, bool noevent)
 {
+	P_D(Blip);
 	this->addContributor(contributor);
 
-	GadgetElement * elt = qobject_cast<GadgetElement*>(this->elementAt(index));
+	BlipPrivate::ElementNode * node = d->m_elements.find(index);
+	if (node == NULL || node->value.m_type != Element::GADGET)
+		return;
+	GadgetElement * elt = qobject_cast<GadgetElement*>(node->value.m_facade);
 	if (elt != NULL)
 		elt->setUserPref(key, value, noevent);
+	else
+		ElementRecord::setUserPref(node->value.m_properties, key, value);
+}
+
+/*!
+	Adds an \a annotation to this Blip. Its range is moved and resized
+	along with the text from now on. Empty ranges are ignored.
+*/
+void Blip::addAnnotation(const Annotation & annotation)
+{
+	P_D(Blip);
+	if (annotation.end() <= annotation.start())
+		return;
+	AnnotationRecord record;
+	record.m_name = annotation.name();
+	record.m_value = annotation.value();
+	d->m_annotations.insert(annotation.start(), record, annotation.end() - annotation.start());
+}
+
+/*!
+	Removes an annotation equal to \a annotation from this Blip.
+*/
+void Blip::removeAnnotation(const Annotation & annotation)
+{
+	P_D(Blip);
+	foreach (OffsetTree<AnnotationRecord>::Node * node, d->m_annotations.overlapping(annotation.start(), annotation.end())) {
+		if (BlipPrivate::toAnnotation(node) == annotation) {
+			d->m_annotations.erase(node);
+			return;
+		}
+	}
+}
+
+/*!
+	Returns the annotations overlapping the range from \a start to \a end,
+	ordered by their start index.
+*/
+QList<Annotation> Blip::annotationsWithin(int start, int end) const
+{
+	const P_D(Blip);
+	QList<Annotation> ret;
+	foreach (OffsetTree<AnnotationRecord>::Node * node, d->m_annotations.overlapping(start, end))
+		ret.append(BlipPrivate::toAnnotation(node));
+	return ret;
+}
+
+/*!
+	Returns all annotations of this Blip ordered by their start index.
+*/
+QList<Annotation> Blip::allAnnotations() const
+{
+	const P_D(Blip);
+	QList<Annotation> ret;
+	foreach (OffsetTree<AnnotationRecord>::Node * node, d->m_annotations.nodes())
+		ret.append(BlipPrivate::toAnnotation(node));
+	return ret;
 }
 
 /*!
 	\property Blip::content
 	\brief the text content of this Blip.
+
+	The text is kept in a gap buffer; this property copies it into a string
+	once after each change. Use contentLength() and contentMid() if only a
+	part of the text is needed.
 */
 QString Blip::content() const
 {
 	const P_D(Blip);
+	if (!d->m_contentValid) {
+		d->m_content = d->m_text.toString();
+		d->m_contentValid = true;
+	}
 	return d->m_content;
 }
 
+/*!
+	\property Blip::contentLength
+	\brief the length of the text content of this Blip.
+*/
+int Blip::contentLength() const
+{
+	const P_D(Blip);
+	return d->m_text.length();
+}
+
+/*!
+	Returns \a length characters of the text content starting at \a index,
+	or all remaining characters if \a length is -1.
+*/
+QString Blip::contentMid(int index, int length) const
+{
+	const P_D(Blip);
+	if (d->m_contentValid)
+		return d->m_content.mid(index, length);
+	return d->m_text.mid(index, length);
+}
+
 /*!
 	Calculate a checksum of this Blip and compare it against the given
 	checksum. Fires outOfSync() if the checksum is wrong. Returns true if the checksum is ok.
@@ -1397,7 +1777,7 @@ QString Blip::content() const
 */
 bool Blip::checkSync(const QByteArray & sum) {
 	P_D(Blip);
-	QByteArray mysum = QCryptographicHash::hash(d->m_content.toUtf8(), QCryptographicHash::Sha1).toHex();
+	QByteArray mysum = BlipPrivate::checksum(this->content());
 	if (sum != mysum) {
 		emit outOfSync();
 		d->m_outofsync = true;
@@ -1406,6 +1786,163 @@ bool Blip::checkSync(const QByteArray & sum) {
 	return true;
 }
 
+/*!
+	\internal
+	Updates this Blip in place to match a snapshot \a record. Only the
+	differences to the current state are applied and signalled; elements
+	which are unchanged or whose gadget state can be updated are kept.
+*/
+void Blip::loadRecord(const BlipRecord & record, IParticipantProvider * pp)
+{
+	P_D(Blip);
+
+	QHash<int, ElementRecord> wanted;
+	foreach (const ElementRecord &erecord, record.m_elements)
+		wanted.insert(erecord.m_id, erecord);
+
+	// Remove the elements which cannot be kept
+	QList<BlipPrivate::ElementNode*> current = d->m_elements.nodes();
+	QSet<int> kept;
+	for (int i = current.size() - 1; i >= 0; i--) {
+		ElementRecord &erecord = current.at(i)->value;
+		if (wanted.contains(erecord.m_id) && wanted[erecord.m_id].m_type == erecord.m_type) {
+			const QVariantMap &properties = wanted[erecord.m_id].m_properties;
+			if (erecord.m_properties == properties) {
+				kept.insert(erecord.m_id);
+				continue;
+			}
+			if (erecord.m_type == Element::GADGET && erecord.m_properties.value("url").toString() == properties.value("url").toString()) {
+				// Only an existing Element object has listeners to notify
+				GadgetElement * gadget = qobject_cast<GadgetElement*>(erecord.m_facade);
+				if (gadget != NULL) {
+					QVariantMap oldFields = gadget->fields(), fields = properties["fields"].toMap(), delta;
+					foreach (QString key, oldFields.keys()) {
+						if (!fields.contains(key))
+							delta[key] = QVariant();
+					}
+					foreach (QString key, fields.keys()) {
+						if (oldFields.value(key) != fields[key])
+							delta[key] = fields[key];
+					}
+					if (!delta.isEmpty())
+						gadget->applyDelta(delta);
+					QVariantMap oldPrefs = gadget->userPrefs(), prefs = properties["userprefs"].toMap();
+					foreach (QString key, prefs.keys()) {
+						if (oldPrefs.value(key) != prefs[key])
+							gadget->setUserPref(key, prefs[key].toString());
+					}
+				}
+				erecord.m_properties = properties;
+				kept.insert(erecord.m_id);
+				continue;
+			}
+		}
+		this->removeElement(OffsetTree<ElementRecord>::position(current.at(i)));
+	}
+
+	QList<ElementRecord> ordered = record.m_elements;
+	qSort(ordered.begin(), ordered.end(), ElementRecord::indexBefore);
+
+	QString content = this->content();
+	QString target;
+	QList<ElementRecord> added;
+	int prefix, suffix;
+	forever {
+		// The target text without the placeholders of the elements to insert
+		QHash<int, int> expected;
+		target.clear();
+		added.clear();
+		int last = 0;
+		foreach (const ElementRecord &erecord, ordered) {
+			if (kept.contains(erecord.m_id))
+				expected.insert(erecord.m_id, erecord.m_index - added.size());
+			else {
+				target += record.m_content.mid(last, qMax(0, erecord.m_index - last));
+				last = erecord.m_index + 1;
+				added.append(erecord);
+			}
+		}
+		target += record.m_content.mid(last);
+
+		int common = qMin(content.length(), target.length());
+		prefix = 0;
+		while (prefix < common && content.at(prefix) == target.at(prefix))
+			prefix++;
+		suffix = 0;
+		while (suffix < common - prefix && content.at(content.length() - 1 - suffix) == target.at(target.length() - 1 - suffix))
+			suffix++;
+
+		// The kept elements must end up where the snapshot has them
+		bool fits = true;
+		int removedEnd = content.length() - suffix;
+		foreach (BlipPrivate::ElementNode * node, d->m_elements.nodes()) {
+			int pos = OffsetTree<ElementRecord>::position(node);
+			if (pos >= prefix && pos < removedEnd)
+				fits = false;
+			else if (pos >= prefix)
+				pos += target.length() - content.length();
+			if (pos != expected.value(node->value.m_id, -1))
+				fits = false;
+		}
+		if (fits)
+			break;
+
+		current = d->m_elements.nodes();
+		for (int i = current.size() - 1; i >= 0; i--)
+			this->removeElement(OffsetTree<ElementRecord>::position(current.at(i)));
+		kept.clear();
+		content = this->content();
+	}
+
+	int removedLength = content.length() - prefix - suffix;
+	if (removedLength > 0) {
+		d->deleteText(prefix, removedLength);
+		emit deletedText(prefix, removedLength);
+		QVariantMap change = BlipPrivate::change("deletedText", prefix);
+		change["length"] = removedLength;
+		this->notifyChange(change);
+	}
+	int insertedLength = target.length() - prefix - suffix;
+	if (insertedLength > 0) {
+		QString text = target.mid(prefix, insertedLength);
+		d->insertText(prefix, text);
+		emit insertedText(prefix, text);
+		QVariantMap change = BlipPrivate::change("insertedText", prefix);
+		change["text"] = text;
+		this->notifyChange(change);
+	}
+	foreach (const ElementRecord &erecord, added) {
+		d->insertText(erecord.m_index, "\n");
+		d->insertElement(erecord.m_index, erecord);
+		emit insertedElement(erecord.m_index);
+		this->notifyChange(BlipPrivate::change("insertedElement", erecord.m_index), true);
+	}
+
+	foreach (QByteArray cid, record.m_contributors)
+		this->addContributor(pp->participant(cid));
+	d->m_version = record.m_version;
+	d->m_submitted = record.m_submitted;
+	d->m_outofsync = false;
+	this->setLastModified(record.m_lastModified);
+}
+
+/*!
+	\internal
+	Removes the element at \a index together with its placeholder character.
+*/
+void Blip::removeElement(int index)
+{
+	P_D(Blip);
+	BlipPrivate::ElementNode * node = d->m_elements.find(index);
+	if (node == NULL)
+		return;
+	Element * element = d->releaseElement(node);
+	d->deleteText(index, 1);
+	emit deletedElement(index);
+	this->notifyChange(BlipPrivate::change("deletedElement", index), true);
+	delete element;
+}
+
 /*!
 	\property Blip::lastModified
 	\brief the date/time of the last modification of this Blip
@@ -1421,9 +1958,43 @@ void Blip::setLastModified(const QDateTime &value)
 	if (d->m_lastModified != value) {
 		d->m_lastModified = value;
 		emit lastModifiedChanged(value);
+		QVariantMap change = BlipPrivate::change("lastModifiedChanged");
+		change["datetime"] = toTimestamp(value);
+		this->notifyChange(change);
 	}
 }
 
+/*!
+	\internal
+	Records a \a change for changesApplied(). Within Wavelet::beginChanges()
+	and Wavelet::endChanges() the changes are collected; otherwise or if
+	\a flush is true, they are emitted right away.
+*/
+void Blip::notifyChange(const QVariantMap & change, bool flush)
+{
+	P_D(Blip);
+	WaveletPrivate * wd = d->m_wavelet->pd_func();
+	if (d->m_changes.isEmpty() && wd->m_changeDepth > 0)
+		wd->m_changedBlips.append(this);
+	BlipPrivate::addChange(d->m_changes, change);
+	if (flush || wd->m_changeDepth == 0)
+		this->flushChanges();
+}
+
+/*!
+	\internal
+	Emits changesApplied() with the collected changes, if any.
+*/
+void Blip::flushChanges()
+{
+	P_D(Blip);
+	if (d->m_changes.isEmpty())
+		return;
+	QVariantList changes = d->m_changes;
+	d->m_changes.clear();
+	emit changesApplied(changes);
+}
+
 /*!
 	Returns the creator of this Blip.
 */
@@ -1449,6 +2020,206 @@ QByteArray BlipPrivate::newTempId()
 	return newId;
 }
 
+/*!
+	\internal
+	Returns the checksum of a Blip's \a content as sent by the server.
+*/
+QByteArray BlipPrivate::checksum(const QString &content)
+{
+	return QCryptographicHash::hash(content.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+/*!
+	\internal
+	Inserts \a text at \a index and moves elements and annotations; no
+	signals are emitted.
+*/
+void BlipPrivate::insertText(int index, const QString &text)
+{
+	this->m_text.insert(index, text);
+	this->m_contentValid = false;
+
+	int length = text.length();
+
+	this->m_elements.shift(index, length);
+
+	// Annotations spanning the index grow, those behind it move
+	foreach (OffsetTree<AnnotationRecord>::Node * node, this->m_annotations.overlapping(index, index + 1)) {
+		if (OffsetTree<AnnotationRecord>::position(node) < index)
+			this->m_annotations.setLength(node, OffsetTree<AnnotationRecord>::length(node) + length);
+	}
+	this->m_annotations.shift(index, length);
+}
+
+/*!
+	\internal
+	Deletes \a length characters at \a index and moves elements and
+	annotations; no signals are emitted.
+*/
+void BlipPrivate::deleteText(int index, int length)
+{
+	this->m_text.remove(index, length);
+	this->m_contentValid = false;
+
+	this->m_elements.shift(index, -length);
+
+	// Cut the deleted range out of the annotations overlapping it
+	int deletedEnd = index + length;
+	foreach (OffsetTree<AnnotationRecord>::Node * node, this->m_annotations.overlapping(index, deletedEnd)) {
+		int start = OffsetTree<AnnotationRecord>::position(node);
+		int end = start + OffsetTree<AnnotationRecord>::length(node);
+		int newLength;
+		if (start >= index)
+			newLength = qMax(0, end - deletedEnd);
+		else
+			newLength = (end <= deletedEnd ? index : end - length) - start;
+		if (newLength == 0)
+			this->m_annotations.erase(node);
+		else
+			this->m_annotations.setLength(node, newLength);
+	}
+	this->m_annotations.shift(index, -length);
+}
+
+/*!
+	\internal
+	Creates a change entry for changesApplied() of the given \a type.
+	A non-negative \a index is included.
+*/
+QVariantMap BlipPrivate::change(const char * type, int index)
+{
+	QVariantMap ret;
+	ret["type"] = QString::fromAscii(type);
+	if (index >= 0)
+		ret["index"] = index;
+	return ret;
+}
+
+/*!
+	\internal
+	Appends a \a change to \a changes. Consecutive text insertions and
+	deletions are merged and only the latest lastModifiedChanged entry is
+	kept, always at the end.
+*/
+void BlipPrivate::addChange(QVariantList &changes, const QVariantMap &change)
+{
+	QString type = change["type"].toString();
+	int end = changes.size();
+	if (end > 0 && changes.last().toMap()["type"].toString() == "lastModifiedChanged") {
+		if (type == "lastModifiedChanged") {
+			changes.last() = change;
+			return;
+		}
+		end--;
+	}
+
+	if (end > 0) {
+		QVariantMap last = changes.at(end - 1).toMap();
+		int index = change["index"].toInt(), lastIndex = last["index"].toInt();
+		if (type == "insertedText" && last["type"].toString() == type) {
+			QString lastText = last["text"].toString();
+			if (index == lastIndex + lastText.length()) {
+				last["text"] = lastText + change["text"].toString();
+				changes[end - 1] = last;
+				return;
+			}
+		}
+		else if (type == "deletedText" && last["type"].toString() == type) {
+			int length = change["length"].toInt();
+			if (index == lastIndex || index + length == lastIndex) {
+				last["index"] = index;
+				last["length"] = last["length"].toInt() + length;
+				changes[end - 1] = last;
+				return;
+			}
+		}
+	}
+	changes.insert(end, change);
+}
+
+/*!
+	\internal
+	Adds an element \a record at \a index and makes it findable by its id.
+	The element has no Element object until facade() is called.
+*/
+BlipPrivate::ElementNode * BlipPrivate::insertElement(int index, const ElementRecord &record)
+{
+	ElementNode * node = this->m_elements.insert(index, record);
+	node->value.m_index = 0;
+	node->value.m_facade = NULL;
+	this->m_elementsById.insert(record.m_id, node);
+	return node;
+}
+
+/*!
+	\internal
+	Takes over a detached \a element; \a ed is the element's private.
+*/
+void BlipPrivate::adoptElement(Element * element, ElementPrivate * ed)
+{
+	ed->m_anchor = this->insertElement(ed->m_record.m_index, ed->m_record);
+	ed->m_anchor->value.m_facade = element;
+	ed->m_owner = this;
+}
+
+/*!
+	\internal
+	Returns the Element object of \a node, creating it on first access.
+	It reads and writes the record in the tree as long as it is anchored.
+*/
+Element * BlipPrivate::facade(Blip * blip, ElementNode * node) const
+{
+	if (node == NULL)
+		return NULL;
+	ElementRecord &record = node->value;
+	if (record.m_facade != NULL)
+		return record.m_facade;
+
+	// Dummy values; the anchored object only looks at the record
+	Element * element;
+	if (record.m_type == Element::GADGET)
+		element = new GadgetElement(blip, 0, 0, QVariantMap());
+	else
+		element = new Element(blip, 0, 0, record.m_type, QVariantMap());
+	ElementPrivate * ed = element->pd_func();
+	ed->m_owner = const_cast<BlipPrivate*>(this);
+	ed->m_anchor = node;
+	record.m_facade = element;
+	return element;
+}
+
+/*!
+	\internal
+	Removes the element of \a node from this Blip. Its Element object, if
+	any, takes a copy of the record including the last position and is
+	returned.
+*/
+Element * BlipPrivate::releaseElement(ElementNode * node)
+{
+	Element * element = node->value.m_facade;
+	if (element != NULL) {
+		ElementPrivate * ed = element->pd_func();
+		ed->m_record = node->value;
+		ed->m_record.m_index = OffsetTree<ElementRecord>::position(node);
+		ed->m_owner = NULL;
+		ed->m_anchor = NULL;
+	}
+	if (this->m_elementsById.value(node->value.m_id) == node)
+		this->m_elementsById.remove(node->value.m_id);
+	this->m_elements.erase(node);
+	return element;
+}
+
+/*!
+	\internal
+	Creates the Annotation value of an annotation \a node.
+*/
+Annotation BlipPrivate::toAnnotation(const OffsetTree<AnnotationRecord>::Node * node)
+{
+	int start = OffsetTree<AnnotationRecord>::position(node);
+	return Annotation(node->value.m_name, start, start + OffsetTree<AnnotationRecord>::length(node), node->value.m_value);
+}
+
 
 /*!
 	\class PyGoWave::Annotation
@@ -1457,89 +2228,78 @@ QByteArray BlipPrivate::newTempId()
 	Example uses of annotations include styling text, supplying spelling
 	corrections, and links to refer that area of text to another Blip or
 	web site. The size of an annotation range must be positive and non-zero.
-*/
 
-/*!
-	Constructs a new Annotation object.
+	Annotations are plain values; the Blip keeps their ranges up to date
+	while the text is edited.
 
-	The annotation's parent Blip, a \a name, \a start and \a end indexes as
-	well as the annotation's \a value must be provided.
+	\sa Blip::annotationsWithin()
 */
-Annotation::Annotation(Blip * blip, const QString & name, int start, int end, const QString & value) : QObject(blip), pd_ptr(new AnnotationPrivate)
-{
-	P_D(Annotation);
-	d->m_blip = blip;
-	d->m_name = name;
-	d->m_start = start;
-	d->m_end = end;
-	d->m_value = value;
-}
 
 /*!
-	Destroys the annotation.
+	Constructs an invalid Annotation.
 */
-Annotation::~Annotation()
+Annotation::Annotation()
 {
-	delete this->pd_ptr;
+	this->m_start = 0;
+	this->m_end = 0;
 }
 
 /*!
-	Returns the Blip on which this element resides.
+	Constructs a new Annotation object with a \a name, \a start and \a end
+	indexes as well as the annotation's \a value.
 */
-Blip * Annotation::blip() const
+Annotation::Annotation(const QString & name, int start, int end, const QString & value)
 {
-	const P_D(Annotation);
-	return d->m_blip;
+	this->m_name = name;
+	this->m_start = start;
+	this->m_end = end;
+	this->m_value = value;
 }
 
 /*!
-	\property Annotation::name
-	\brief the name of this annotation.
+	Returns the name of this annotation.
 */
 QString Annotation::name() const
 {
-	const P_D(Annotation);
-	return d->m_name;
+	return this->m_name;
 }
 
 /*!
-	\property Annotation::start
-	\brief the start index of this annotation.
+	Returns the start index of this annotation.
 */
 int Annotation::start() const
 {
-	const P_D(Annotation);
-	return d->m_start;
+	return this->m_start;
 }
 void Annotation::setStart(int index)
 {
-	P_D(Annotation);
-	d->m_start = index;
+	this->m_start = index;
 }
 
 /*!
-	\property Annotation::end
-	\brief the end index of this annotation.
+	Returns the end index of this annotation.
 */
 int Annotation::end() const
 {
-	const P_D(Annotation);
-	return d->m_end;
+	return this->m_end;
 }
 void Annotation::setEnd(int index)
 {
-	P_D(Annotation);
-	d->m_end = index;
+	this->m_end = index;
 }
 
 /*!
-	\property Annotation::value
-	\brief the value of this annotation.
+	Returns the value of this annotation.
 */
 QString Annotation::value() const
 {
-	const P_D(Annotation);
-	return d->m_value;
+	return this->m_value;
+}
+
+bool Annotation::operator==(const Annotation & other) const
+{
+	return this->m_name == other.m_name && this->m_start == other.m_start
+		&& this->m_end == other.m_end && this->m_value == other.m_value;
 }
 
 
@@ -1552,6 +2312,10 @@ QString Annotation::value() const
 
 	Only special Wave Client elements are treated here.
 	There are no HTML elements in any Blip. All markup is handled by Annotations.
+
+	A Blip stores its elements as plain data and creates Element objects only
+	when they are requested, e.g. by Blip::elementAt(). Such an object is a
+	view on the Blip's data as long as the element is part of the Blip.
 */
 
 /*!
@@ -1593,31 +2357,43 @@ Element::Element(Blip * blip, int id, int position, Element::Type type, const QV
 	P_D(Element);
 	d->m_blip = blip;
 	if (id < 0)
-		d->m_id = ElementPrivate::newTempId();
+		d->m_record.m_id = ElementPrivate::newTempId();
 	else
-		d->m_id = id;
-	d->m_pos = position;
-	d->m_type = type;
-	d->m_properties = properties;
+		d->m_record.m_id = id;
+	d->m_record.m_index = position;
+	d->m_record.m_type = type;
+	d->m_record.m_properties = properties;
+	d->m_record.m_facade = this;
+	d->m_owner = NULL;
+	d->m_anchor = NULL;
 }
 
 Element::Element(Blip * blip, int id, int position, Element::Type type, const QVariantMap & properties, ElementPrivate * d) : QObject(blip), pd_ptr(d)
 {
 	d->m_blip = blip;
 	if (id < 0)
-		d->m_id = ElementPrivate::newTempId();
+		d->m_record.m_id = ElementPrivate::newTempId();
 	else
-		d->m_id = id;
-	d->m_pos = position;
-	d->m_type = type;
-	d->m_properties = properties;
+		d->m_record.m_id = id;
+	d->m_record.m_index = position;
+	d->m_record.m_type = type;
+	d->m_record.m_properties = properties;
+	d->m_record.m_facade = this;
+	d->m_owner = NULL;
+	d->m_anchor = NULL;
 }
 
 /*!
 	Destroys the Element.
+
+	If the Element is part of a Blip, only this object goes away; the Blip
+	keeps the element and creates a new object on the next access.
 */
 Element::~Element()
 {
+	P_D(Element);
+	if (d->m_anchor != NULL)
+		d->m_anchor->value.m_facade = NULL;
 	delete this->pd_ptr;
 }
 
@@ -1653,7 +2429,7 @@ void Element::setBlip(Blip * blip)
 int Element::id() const
 {
 	const P_D(Element);
-	return d->m_id;
+	return d->record().m_id;
 }
 
 /*!
@@ -1663,7 +2439,7 @@ int Element::id() const
 Element::Type Element::type() const
 {
 	const P_D(Element);
-	return d->m_type;
+	return d->record().m_type;
 }
 
 /*!
@@ -1673,12 +2449,17 @@ Element::Type Element::type() const
 int Element::position() const
 {
 	const P_D(Element);
-	return d->m_pos;
+	if (d->m_anchor != NULL)
+		return OffsetTree<ElementRecord>::position(d->m_anchor);
+	return d->m_record.m_index;
 }
 void Element::setPosition(int pos)
 {
 	P_D(Element);
-	d->m_pos = pos;
+	if (d->m_anchor != NULL)
+		d->m_owner->m_elements.move(d->m_anchor, pos);
+	else
+		d->m_record.m_index = pos;
 }
 
 int ElementPrivate::g_lastTempId = 0;
@@ -1726,8 +2507,9 @@ GadgetElement::~GadgetElement() {}
 QVariantMap GadgetElement::fields() const
 {
 	const P_D(GadgetElement);
-	if (d->m_properties.contains("fields"))
-		return d->m_properties["fields"].toMap();
+	const QVariantMap &properties = d->record().m_properties;
+	if (properties.contains("fields"))
+		return properties["fields"].toMap();
 	else
 		return QVariantMap();
 }
@@ -1739,8 +2521,9 @@ QVariantMap GadgetElement::fields() const
 QVariantMap GadgetElement::userPrefs() const
 {
 	const P_D(GadgetElement);
-	if (d->m_properties.contains("userprefs"))
-		return d->m_properties["userprefs"].toMap();
+	const QVariantMap &properties = d->record().m_properties;
+	if (properties.contains("userprefs"))
+		return properties["userprefs"].toMap();
 	else
 		return QVariantMap();
 }
@@ -1752,8 +2535,9 @@ QVariantMap GadgetElement::userPrefs() const
 QString GadgetElement::url() const
 {
 	const P_D(GadgetElement);
-	if (d->m_properties.contains("url"))
-		return d->m_properties["url"].toString();
+	const QVariantMap &properties = d->record().m_properties;
+	if (properties.contains("url"))
+		return properties["url"].toString();
 	else
 		return QString();
 }
@@ -1766,19 +2550,7 @@ QString GadgetElement::url() const
 void GadgetElement::applyDelta(const QVariantMap & delta)
 {
 	P_D(GadgetElement);
-	QVariantMap fields = this->fields();
-
-	foreach (QString key, delta.keys()) {
-		QVariant data = delta[key];
-		if (data.isNull()) {
-			if (fields.contains(key))
-				fields.remove(key);
-		}
-		else
-			fields[key] = data;
-	}
-
-	d->m_properties["fields"] = fields;
+	ElementRecord::applyDelta(d->record().m_properties, delta);
 	emit stateChange();
 }
 
@@ -1789,9 +2561,7 @@ void GadgetElement::applyDelta(const QVariantMap & delta)
 void GadgetElement::setUserPref(const QString & key, const QString & value, bool noevent)
 {
 	P_D(GadgetElement);
-	QVariantMap userprefs = this->userPrefs();
-	userprefs[key] = value;
-	d->m_properties["userprefs"] = userprefs;
+	ElementRecord::setUserPref(d->record().m_properties, key, value);
 	if (!noevent)
 		emit userPrefSet(key, value);
 }
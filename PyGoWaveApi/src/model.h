@@ -33,12 +33,12 @@
 namespace PyGoWave {
 
 	class ParticipantPrivate;
-	class AnnotationPrivate;
 	class ElementPrivate;
 	class GadgetElementPrivate;
 	class WaveModelPrivate;
 	class WaveletPrivate;
 	class BlipPrivate;
+	class BlipRecord;
 
 	class PYGOWAVE_API_SHARED_EXPORT Participant : public QObject
 	{
@@ -96,18 +96,11 @@ namespace PyGoWave {
 	class Blip;
 	class Operation;
 
-	class PYGOWAVE_API_SHARED_EXPORT Annotation : public QObject
+	class PYGOWAVE_API_SHARED_EXPORT Annotation
 	{
-		Q_OBJECT
-		P_DECLARE_PRIVATE(Annotation)
-		Q_PROPERTY(QString name READ name)
-		Q_PROPERTY(int start READ start WRITE setStart)
-		Q_PROPERTY(int end READ end WRITE setEnd)
-		Q_PROPERTY(QString value READ value)
-
 	public:
-		Annotation(Blip * blip, const QString & name, int start, int end, const QString & value);
-		~Annotation();
+		Annotation();
+		Annotation(const QString & name, int start, int end, const QString & value);
 
 		QString name() const;
 
@@ -119,10 +112,13 @@ namespace PyGoWave {
 
 		QString value() const;
 
-		Blip * blip() const;
+		bool operator==(const Annotation & other) const;
 
 	private:
-		AnnotationPrivate * const pd_ptr;
+		QString m_name;
+		int m_start;
+		int m_end;
+		QString m_value;
 	};
 
 	class PYGOWAVE_API_SHARED_EXPORT Element : public QObject
@@ -165,6 +161,10 @@ namespace PyGoWave {
 	protected:
 		Element(Blip * blip, int id, int position, Type type, const QVariantMap & properties, ElementPrivate * d);
 		ElementPrivate * const pd_ptr;
+
+	private:
+		friend class Blip;
+		friend class BlipPrivate;
 	};
 
 	class PYGOWAVE_API_SHARED_EXPORT GadgetElement : public Element
@@ -335,6 +335,9 @@ namespace PyGoWave {
 
 		void checkSync(const QMap<QByteArray, QByteArray> & blipsums);
 
+		void beginChanges();
+		void endChanges();
+
 		void applyOperations(
 				const QList<Operation*> & operations,
 				const QDateTime &timestamp,
@@ -354,6 +357,7 @@ namespace PyGoWave {
 		void lastModifiedChanged(const QDateTime &datetime);
 
 	private:
+		friend class Blip;
 		WaveletPrivate * const pd_ptr;
 	};
 
@@ -364,6 +368,7 @@ namespace PyGoWave {
 		Q_PROPERTY(QByteArray id READ id)
 		Q_PROPERTY(bool root READ isRoot)
 		Q_PROPERTY(QString content READ content)
+		Q_PROPERTY(int contentLength READ contentLength)
 		Q_PROPERTY(QDateTime lastModified READ lastModified WRITE setLastModified)
 
 	public:
@@ -388,6 +393,8 @@ namespace PyGoWave {
 		bool isRoot() const;
 
 		QString content() const;
+		int contentLength() const;
+		Q_INVOKABLE QString contentMid(int index, int length = -1) const;
 
 		QDateTime lastModified() const;
 		void setLastModified(const QDateTime &value);
@@ -403,6 +410,9 @@ namespace PyGoWave {
 		Element * elementAt(int index) const;
 		QList<Element*> elementsWithin(int start, int end) const;
 		QList<Element*> allElements() const;
+		QList<int> elementIdsWithin(int start, int end) const;
+		QList<int> allElementIds() const;
+		Element::Type elementTypeById(int id) const;
 
 		void insertElement(int index, Element::Type type, const QVariantMap & properties, Participant * contributor, bool noevent = false);
 		void deleteElement(int index, Participant * contributor, bool noevent = false);
@@ -411,6 +421,11 @@ namespace PyGoWave {
 		void applyElementDelta(int index, const QVariantMap & delta, Participant * contributor);
 		void setElementUserpref(int index, const QString & key, const QString & value, Participant * contributor, bool noevent = false);
 
+		void addAnnotation(const Annotation & annotation);
+		void removeAnnotation(const Annotation & annotation);
+		QList<Annotation> annotationsWithin(int start, int end) const;
+		QList<Annotation> allAnnotations() const;
+
 		bool checkSync(const QByteArray & sum);
 
 	signals:
@@ -422,8 +437,16 @@ namespace PyGoWave {
 		void lastModifiedChanged(const QDateTime &datetime);
 		void idChanged(const QByteArray &oldId, const QByteArray &newId);
 		void contributorAdded(const QByteArray &id);
+		void changesApplied(const QVariantList &changes);
 
 	private:
+		friend class Wavelet;
+		friend class WaveletPrivate;
+		void loadRecord(const BlipRecord & record, IParticipantProvider * pp);
+		void removeElement(int index);
+		void notifyChange(const QVariantMap & change, bool flush = false);
+		void flushChanges();
+
 		BlipPrivate * const pd_ptr;
 	};
 
@@ -21,6 +21,11 @@
 #ifndef MODEL_P_H
 #define MODEL_P_H
 
+#include "gapbuffer_p.h"
+#include "offsettree_p.h"
+
+#include <QtCore/QHash>
+
 namespace PyGoWave {
 
 	class ParticipantPrivate
@@ -34,25 +39,39 @@ namespace PyGoWave {
 		bool m_bot;
 	};
 
-	class AnnotationPrivate
+	class AnnotationRecord
 	{
 	public:
-		Blip * m_blip;
 		QString m_name;
-		int m_start;
-		int m_end;
 		QString m_value;
 	};
 
-	class ElementPrivate
+	class ElementRecord
 	{
 	public:
-		Blip * m_blip;
 		int m_id;
-		int m_pos;
+		int m_index; // Only used outside of a Blip's element tree
 		Element::Type m_type;
-
 		QVariantMap m_properties;
+		Element * m_facade; // Created on demand
+
+		static bool indexBefore(const ElementRecord &a, const ElementRecord &b);
+		static void applyDelta(QVariantMap &properties, const QVariantMap &delta);
+		static void setUserPref(QVariantMap &properties, const QString &key, const QString &value);
+	};
+
+	class ElementPrivate
+	{
+	public:
+		ElementRecord &record() { return this->m_anchor != NULL ? this->m_anchor->value : this->m_record; }
+		const ElementRecord &record() const { return this->m_anchor != NULL ? this->m_anchor->value : this->m_record; }
+
+		Blip * m_blip;
+		ElementRecord m_record; // Only used while not anchored in a Blip
+
+		BlipPrivate * m_owner;
+		OffsetTree<ElementRecord>::Node * m_anchor;
+
 		static int newTempId();
 
 		static int g_lastTempId;
@@ -72,10 +91,40 @@ namespace PyGoWave {
 		IParticipantProvider * m_pp;
 	};
 
+	class BlipRecord
+	{
+	public:
+		static BlipRecord fromSnapshot(const QByteArray &id, const QVariantMap &blip);
+		static QList<BlipRecord> fromSnapshot(const QVariantMap &blips);
+		static bool createdBefore(const BlipRecord &a, const BlipRecord &b);
+
+		QByteArray m_id;
+		quint64 m_creationTime;
+		QString m_content;
+		QList<ElementRecord> m_elements;
+		QByteArray m_creator;
+		QList<QByteArray> m_contributors;
+		QDateTime m_lastModified;
+		int m_version;
+		bool m_submitted;
+	};
+
+	class BlipSlot
+	{
+	public:
+		Blip * m_blip; // NULL until materialized from m_record
+		QByteArray m_id;
+		BlipRecord m_record;
+		bool m_root;
+	};
+
 	class WaveletPrivate
 	{
 	public:
+		typedef OffsetTree<BlipSlot>::Node BlipNode;
+
 		void setRootBlip(Blip * blip);
+		Blip * materializeBlip(Wavelet * wavelet, BlipNode * node) const;
 
 		WaveModel * m_wave;
 
@@ -88,18 +137,27 @@ namespace PyGoWave {
 		int m_version;
 
 		QMap<QByteArray, Participant*> m_participants;
-		QList<Blip*> m_blips;
+		OffsetTree<BlipSlot> m_blips; // Positioned by index
+		QHash<QByteArray, BlipNode*> m_blipsById;
 		Blip * m_rootBlip;
 		QByteArray m_status;
+
+		int m_changeDepth; // Nesting of beginChanges()
+		QList< QPointer<Blip> > m_changedBlips; // With changes to emit on endChanges()
 	};
 
 	class BlipPrivate
 	{
 	public:
+		typedef OffsetTree<ElementRecord>::Node ElementNode;
+
 		Wavelet * m_wavelet;
 		QByteArray m_id;
-		QString m_content;
-		QList<Element*> m_elements;
+		GapBuffer m_text;
+		mutable QString m_content; // Materialized from m_text on demand
+		mutable bool m_contentValid;
+		OffsetTree<ElementRecord> m_elements;
+		QHash<int, ElementNode*> m_elementsById;
 		Blip * m_parent;
 		Participant * m_creator;
 		QMap<QByteArray, Participant*> m_contributors;
@@ -108,9 +166,22 @@ namespace PyGoWave {
 		int m_version;
 		bool m_submitted;
 		bool m_outofsync;
-		QList<Annotation*> m_annotations;
+		OffsetTree<AnnotationRecord> m_annotations; // Ranges are the node lengths
+		QVariantList m_changes; // Not yet emitted with changesApplied()
+
+		void insertText(int index, const QString &text);
+		void deleteText(int index, int length);
+		ElementNode * insertElement(int index, const ElementRecord &record);
+		void adoptElement(Element * element, ElementPrivate * ed);
+		Element * facade(Blip * blip, ElementNode * node) const;
+		Element * releaseElement(ElementNode * node);
+
+		static Annotation toAnnotation(const OffsetTree<AnnotationRecord>::Node * node);
+		static QVariantMap change(const char * type, int index = -1);
+		static void addChange(QVariantList &changes, const QVariantMap &change);
 
 		static QByteArray newTempId();
+		static QByteArray checksum(const QString &content);
 
 		static int g_lastTempId;
 	};
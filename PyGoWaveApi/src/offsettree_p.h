@@ -0,0 +1,422 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OFFSETTREE_P_H
+#define OFFSETTREE_P_H
+
+#include "pygowave_api_global.h"
+
+#include <QtCore/QList>
+
+#include <limits.h>
+
+namespace PyGoWave {
+
+	/*!
+		\internal
+		\class PyGoWave::OffsetTree
+		\brief Ordered multiset of values anchored at text positions.
+
+		The tree is a treap whose nodes store their position relative to
+		their parent, so shifting all positions behind an edit only touches
+		O(log n) nodes. Node pointers stay valid until the node is erased;
+		its position can be read at any time with position().
+
+		A node may also cover a range of text by having a length. Every node
+		knows the furthest end within its subtree, which makes the tree an
+		interval tree for overlapping().
+	*/
+	template <typename T>
+	class OffsetTree
+	{
+	public:
+		class Node
+		{
+		public:
+			T value;
+
+		private:
+			friend class OffsetTree<T>;
+
+			Node(const T &v, int offset, int length, quint32 priority)
+				: value(v), m_left(NULL), m_right(NULL), m_parent(NULL), m_offset(offset),
+				m_length(length), m_reach(length), m_priority(priority) {}
+
+			Node * m_left;
+			Node * m_right;
+			Node * m_parent;
+			int m_offset; // Relative to the parent's position
+			int m_length;
+			int m_reach; // Furthest end within the subtree, relative to the node
+			quint32 m_priority;
+		};
+
+		OffsetTree() : m_root(NULL), m_size(0), m_seed(0x9e3779b9u) {}
+		~OffsetTree() { OffsetTree::destroy(this->m_root); }
+
+		int size() const { return this->m_size; }
+		bool isEmpty() const { return this->m_size == 0; }
+
+		void clear()
+		{
+			OffsetTree::destroy(this->m_root);
+			this->m_root = NULL;
+			this->m_size = 0;
+		}
+
+		/*!
+			Adds \a value at \a position, behind all values at the same
+			position. The value covers \a length characters from there.
+		*/
+		Node * insert(int position, const T &value, int length = 0)
+		{
+			Node * node = new Node(value, position, length, this->nextPriority());
+			this->link(node);
+			this->m_size++;
+			return node;
+		}
+
+		void erase(Node * node)
+		{
+			this->unlink(node);
+			delete node;
+			this->m_size--;
+		}
+
+		void move(Node * node, int position)
+		{
+			this->unlink(node);
+			node->m_offset = position;
+			this->link(node);
+		}
+
+		void setLength(Node * node, int length)
+		{
+			node->m_length = length;
+			for (; node != NULL; node = node->m_parent)
+				OffsetTree::update(node);
+		}
+
+		/*!
+			Adds \a delta to all positions from \a position onwards. A negative
+			\a delta removes the range [position, position - delta); values
+			inside of it are moved to \a position.
+		*/
+		void shift(int position, int delta)
+		{
+			if (delta == 0 || this->m_root == NULL)
+				return;
+			Node * left, * right, * middle = NULL;
+			OffsetTree::split(this->m_root, position, left, right);
+			if (delta < 0) {
+				OffsetTree::split(right, position - delta, middle, right);
+				if (middle != NULL)
+					OffsetTree::collapse(middle, position);
+			}
+			if (right != NULL)
+				right->m_offset += delta;
+			this->m_root = OffsetTree::merge(OffsetTree::merge(left, middle), right);
+		}
+
+		/*!
+			Returns the first node at \a position or NULL.
+		*/
+		Node * find(int position) const
+		{
+			Node * node = this->lowerBound(position);
+			if (node != NULL && OffsetTree::position(node) == position)
+				return node;
+			return NULL;
+		}
+
+		/*!
+			Returns the first node at or behind \a position or NULL.
+		*/
+		Node * lowerBound(int position) const
+		{
+			Node * ret = NULL;
+			int base = 0;
+			for (Node * node = this->m_root; node != NULL;) {
+				base += node->m_offset;
+				if (base >= position) {
+					ret = node;
+					node = node->m_left;
+				}
+				else
+					node = node->m_right;
+			}
+			return ret;
+		}
+
+		/*!
+			Returns the values within [\a start, \a end) ordered by position.
+		*/
+		QList<T> within(int start, int end) const
+		{
+			QList<T> ret;
+			OffsetTree::collect(this->m_root, 0, start, end, ret);
+			return ret;
+		}
+
+		QList<Node*> nodesWithin(int start, int end) const
+		{
+			QList<Node*> ret;
+			OffsetTree::collectNodes(this->m_root, 0, start, end, ret);
+			return ret;
+		}
+
+		QList<T> values() const
+		{
+			QList<T> ret;
+			OffsetTree::collect(this->m_root, 0, INT_MIN, INT_MAX, ret);
+			return ret;
+		}
+
+		/*!
+			Returns the nodes whose range overlaps [\a start, \a end), ordered
+			by position.
+		*/
+		QList<Node*> overlapping(int start, int end) const
+		{
+			QList<Node*> ret;
+			OffsetTree::collectOverlapping(this->m_root, 0, start, end, ret);
+			return ret;
+		}
+
+		QList<Node*> nodes() const
+		{
+			QList<Node*> ret;
+			OffsetTree::collectNodes(this->m_root, ret);
+			return ret;
+		}
+
+		static int position(const Node * node)
+		{
+			int ret = 0;
+			for (; node != NULL; node = node->m_parent)
+				ret += node->m_offset;
+			return ret;
+		}
+
+		static int length(const Node * node)
+		{
+			return node->m_length;
+		}
+
+	private:
+		Q_DISABLE_COPY(OffsetTree)
+
+		quint32 nextPriority()
+		{
+			// xorshift32
+			this->m_seed ^= this->m_seed << 13;
+			this->m_seed ^= this->m_seed >> 17;
+			this->m_seed ^= this->m_seed << 5;
+			return this->m_seed;
+		}
+
+		void link(Node * node)
+		{
+			Node * left, * right;
+			OffsetTree::split(this->m_root, node->m_offset + 1, left, right);
+			this->m_root = OffsetTree::merge(OffsetTree::merge(left, node), right);
+		}
+
+		void unlink(Node * node)
+		{
+			Node * parent = node->m_parent;
+			Node * left = OffsetTree::detach(node->m_left, node);
+			Node * right = OffsetTree::detach(node->m_right, node);
+			node->m_left = node->m_right = node->m_parent = NULL;
+			node->m_reach = node->m_length;
+
+			// The children are now relative to the node's parent, like the node was
+			Node * merged = OffsetTree::merge(left, right);
+			if (merged != NULL)
+				merged->m_parent = parent;
+			if (parent == NULL)
+				this->m_root = merged;
+			else if (parent->m_left == node)
+				parent->m_left = merged;
+			else
+				parent->m_right = merged;
+			for (; parent != NULL; parent = parent->m_parent)
+				OffsetTree::update(parent);
+		}
+
+		static void update(Node * node)
+		{
+			int reach = node->m_length;
+			if (node->m_left != NULL)
+				reach = qMax(reach, node->m_left->m_offset + node->m_left->m_reach);
+			if (node->m_right != NULL)
+				reach = qMax(reach, node->m_right->m_offset + node->m_right->m_reach);
+			node->m_reach = reach;
+		}
+
+		// Makes child a root in the coordinates parent is in
+		static Node * detach(Node * child, Node * parent)
+		{
+			if (child != NULL) {
+				child->m_offset += parent->m_offset;
+				child->m_parent = NULL;
+			}
+			return child;
+		}
+
+		static Node * attach(Node * child, Node * parent)
+		{
+			if (child != NULL) {
+				child->m_offset -= parent->m_offset;
+				child->m_parent = parent;
+			}
+			return child;
+		}
+
+		// Splits root into the nodes before position and the nodes from position on
+		static void split(Node * root, int position, Node *& left, Node *& right)
+		{
+			if (root == NULL) {
+				left = right = NULL;
+				return;
+			}
+			if (root->m_offset < position) {
+				Node * a, * b;
+				OffsetTree::split(OffsetTree::detach(root->m_right, root), position, a, b);
+				root->m_right = OffsetTree::attach(a, root);
+				OffsetTree::update(root);
+				left = root;
+				right = b;
+			}
+			else {
+				Node * a, * b;
+				OffsetTree::split(OffsetTree::detach(root->m_left, root), position, a, b);
+				root->m_left = OffsetTree::attach(b, root);
+				OffsetTree::update(root);
+				left = a;
+				right = root;
+			}
+		}
+
+		// All positions in left must not be behind those in right
+		static Node * merge(Node * left, Node * right)
+		{
+			if (left == NULL)
+				return right;
+			if (right == NULL)
+				return left;
+			if (left->m_priority > right->m_priority) {
+				Node * merged = OffsetTree::merge(OffsetTree::detach(left->m_right, left), right);
+				left->m_right = OffsetTree::attach(merged, left);
+				OffsetTree::update(left);
+				return left;
+			}
+			else {
+				Node * merged = OffsetTree::merge(left, OffsetTree::detach(right->m_left, right));
+				right->m_left = OffsetTree::attach(merged, right);
+				OffsetTree::update(right);
+				return right;
+			}
+		}
+
+		static void collapse(Node * root, int position)
+		{
+			root->m_offset = position;
+			OffsetTree::clearOffsets(root->m_left);
+			OffsetTree::clearOffsets(root->m_right);
+			OffsetTree::update(root);
+		}
+
+		static void clearOffsets(Node * node)
+		{
+			if (node == NULL)
+				return;
+			node->m_offset = 0;
+			OffsetTree::clearOffsets(node->m_left);
+			OffsetTree::clearOffsets(node->m_right);
+			OffsetTree::update(node);
+		}
+
+		static void collect(const Node * node, int base, int start, int end, QList<T> &list)
+		{
+			if (node == NULL)
+				return;
+			int pos = base + node->m_offset;
+			if (pos >= start)
+				OffsetTree::collect(node->m_left, pos, start, end, list);
+			if (pos >= start && pos < end)
+				list.append(node->value);
+			if (pos < end)
+				OffsetTree::collect(node->m_right, pos, start, end, list);
+		}
+
+		static void collectNodes(Node * node, int base, int start, int end, QList<Node*> &list)
+		{
+			if (node == NULL)
+				return;
+			int pos = base + node->m_offset;
+			if (pos >= start)
+				OffsetTree::collectNodes(node->m_left, pos, start, end, list);
+			if (pos >= start && pos < end)
+				list.append(node);
+			if (pos < end)
+				OffsetTree::collectNodes(node->m_right, pos, start, end, list);
+		}
+
+		static void collectOverlapping(Node * node, int base, int start, int end, QList<Node*> &list)
+		{
+			if (node == NULL)
+				return;
+			int pos = base + node->m_offset;
+			if (pos + node->m_reach <= start)
+				return; // Everything in here ends before start
+			OffsetTree::collectOverlapping(node->m_left, pos, start, end, list);
+			if (pos < end && pos + node->m_length > start)
+				list.append(node);
+			if (pos < end)
+				OffsetTree::collectOverlapping(node->m_right, pos, start, end, list);
+		}
+
+		static void collectNodes(Node * node, QList<Node*> &list)
+		{
+			if (node == NULL)
+				return;
+			OffsetTree::collectNodes(node->m_left, list);
+			list.append(node);
+			OffsetTree::collectNodes(node->m_right, list);
+		}
+
+		static void destroy(Node * node)
+		{
+			if (node == NULL)
+				return;
+			OffsetTree::destroy(node->m_left);
+			OffsetTree::destroy(node->m_right);
+			delete node;
+		}
+
+		Node * m_root;
+		int m_size;
+		quint32 m_seed;
+	};
+}
+
+#endif // OFFSETTREE_P_H
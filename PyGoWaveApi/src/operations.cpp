@@ -475,8 +475,10 @@ QList<Operation*> OpManager::transform(Operation * input_op)
 		int j = 0;
 		while (j < op_lst.size()) {
 			Operation * op = op_lst[j];
-			if (!op->isCompatibleTo(myop))
+			if (!op->isCompatibleTo(myop)) {
+				j++;
 				continue;
+			}
 			int end = 0;
 			if (op->isDelete() && myop->isDelete()) {
 				if (op->index() < myop->index()) {
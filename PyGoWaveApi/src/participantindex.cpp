@@ -0,0 +1,110 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "participantindex_p.h"
+
+#include <QtCore/QtAlgorithms>
+#include <QtCore/QSet>
+#include <QtCore/QRegExp>
+
+using namespace PyGoWave;
+
+/*!
+	\internal
+	\class PyGoWave::ParticipantIndex
+	\brief Sorted array of lower case search keys of known participants for
+	prefix lookups.
+
+	The keys of a participant are its id, the part of the id before the "@"
+	and every word of its display name.
+*/
+
+/*!
+	Adds \a id with \a displayName to the index, replacing the keys it was
+	indexed with before.
+*/
+void ParticipantIndex::insert(const QByteArray &id, const QString &displayName)
+{
+	QStringList keys = ParticipantIndex::keysFor(id, displayName);
+	if (this->m_participantKeys.value(id) == keys)
+		return;
+	this->remove(id);
+	foreach (QString key, keys) {
+		Key entry(key, id);
+		this->m_keys.insert(qLowerBound(this->m_keys.begin(), this->m_keys.end(), entry), entry);
+	}
+	this->m_participantKeys.insert(id, keys);
+}
+
+void ParticipantIndex::remove(const QByteArray &id)
+{
+	foreach (QString key, this->m_participantKeys.take(id)) {
+		Key entry(key, id);
+		QList<Key>::iterator it = qBinaryFind(this->m_keys.begin(), this->m_keys.end(), entry);
+		if (it != this->m_keys.end())
+			this->m_keys.erase(it);
+	}
+}
+
+void ParticipantIndex::clear()
+{
+	this->m_keys.clear();
+	this->m_participantKeys.clear();
+}
+
+/*!
+	Returns up to \a limit ids of participants with a key starting with
+	\a prefix (case insensitive), in key order.
+*/
+QList<QByteArray> ParticipantIndex::search(const QString &prefix, int limit) const
+{
+	QList<QByteArray> ret;
+	QString p = prefix.simplified().toLower();
+	if (p.isEmpty())
+		return ret;
+	QSet<QByteArray> seen;
+	QList<Key>::const_iterator it = qLowerBound(this->m_keys.constBegin(), this->m_keys.constEnd(), Key(p, QByteArray()));
+	for (; it != this->m_keys.constEnd() && it->first.startsWith(p) && ret.size() < limit; ++it) {
+		if (!seen.contains(it->second)) {
+			seen.insert(it->second);
+			ret.append(it->second);
+		}
+	}
+	return ret;
+}
+
+QStringList ParticipantIndex::keysFor(const QByteArray &id, const QString &displayName)
+{
+	QStringList keys;
+	QString s_id = QString::fromAscii(id).toLower();
+	keys.append(s_id);
+	int at = s_id.indexOf('@');
+	if (at > 0)
+		keys.append(s_id.left(at));
+	foreach (QString word, displayName.toLower().split(QRegExp("\\s+"), QString::SkipEmptyParts)) {
+		if (!keys.contains(word))
+			keys.append(word);
+	}
+	if (displayName.contains(' '))
+		keys.append(displayName.toLower().simplified()); // Full name, for prefixes with spaces
+	qSort(keys);
+	return keys;
+}
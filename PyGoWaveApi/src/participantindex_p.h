@@ -0,0 +1,54 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PARTICIPANTINDEX_P_H
+#define PARTICIPANTINDEX_P_H
+
+#include "pygowave_api_global.h"
+
+#include <QtCore/QList>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+namespace PyGoWave {
+
+	class ParticipantIndex
+	{
+	public:
+		void insert(const QByteArray &id, const QString &displayName);
+		void remove(const QByteArray &id);
+		void clear();
+
+		QList<QByteArray> search(const QString &prefix, int limit = 20) const;
+
+	private:
+		typedef QPair<QString,QByteArray> Key;
+
+		static QStringList keysFor(const QByteArray &id, const QString &displayName);
+
+		QList<Key> m_keys; // Sorted
+		QHash<QByteArray,QStringList> m_participantKeys;
+	};
+}
+
+#endif // PARTICIPANTINDEX_P_H
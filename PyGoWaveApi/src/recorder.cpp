@@ -0,0 +1,319 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "recorder.h"
+#include "controller.h"
+
+#include <QStomp/qstomp.h>
+
+#include <QtCore/QTimer>
+
+using namespace PyGoWave;
+
+const quint32 FrameRecorderPrivate::g_magic = 0x50475752; // "PGWR"
+const quint32 FrameRecorderPrivate::g_version = 1;
+
+/*!
+	\class PyGoWave::FrameRecorder
+	\brief Writes the STOMP frames of a Controller session to a file.
+
+	Attach a recorder with Controller::setFrameRecorder(). Each frame is
+	stored with its direction, frame type, destination, content encoding,
+	body and the time in microseconds since the recording was opened.
+	Recordings can be fed back into a Controller with FrameReplayer.
+*/
+
+/*!
+	Constructs a closed FrameRecorder.
+*/
+FrameRecorder::FrameRecorder(QObject * parent) : QObject(parent), pd_ptr(new FrameRecorderPrivate)
+{
+	P_D(FrameRecorder);
+	d->m_start = 0;
+}
+
+/*!
+	Closes the recording and destroys the FrameRecorder.
+*/
+FrameRecorder::~FrameRecorder()
+{
+	this->close();
+	delete this->pd_ptr;
+}
+
+/*!
+	Opens the file \a fileName for recording, truncating it. Returns false
+	if the file cannot be opened.
+*/
+bool FrameRecorder::open(const QString &fileName)
+{
+	P_D(FrameRecorder);
+	this->close();
+	d->m_file.setFileName(fileName);
+	if (!d->m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qWarning("FrameRecorder: Cannot open '%s' for writing!", qPrintable(fileName));
+		return false;
+	}
+	d->m_stream.setDevice(&d->m_file);
+	d->m_stream.setVersion(QDataStream::Qt_4_5);
+	d->m_stream << FrameRecorderPrivate::g_magic << FrameRecorderPrivate::g_version;
+	d->m_start = monotonicMicroseconds();
+	return true;
+}
+
+/*!
+	Flushes and closes the recording.
+*/
+void FrameRecorder::close()
+{
+	P_D(FrameRecorder);
+	if (!d->m_file.isOpen())
+		return;
+	d->m_stream.setDevice(NULL);
+	d->m_file.close();
+}
+
+/*!
+	Returns true if a recording is open.
+*/
+bool FrameRecorder::isOpen() const
+{
+	const P_D(FrameRecorder);
+	return d->m_file.isOpen();
+}
+
+/*!
+	Appends a frame to the recording. \a type is a QStompResponseFrame::ResponseType
+	for inbound and a QStompRequestFrame::RequestType for outbound frames.
+*/
+void FrameRecorder::recordFrame(Direction direction, int type, const QByteArray &destination, const QByteArray &contentEncoding, const QByteArray &body)
+{
+	P_D(FrameRecorder);
+	if (!d->m_file.isOpen())
+		return;
+	d->m_stream << (qint64) (monotonicMicroseconds() - d->m_start) << (quint8) direction << (quint8) type << destination << contentEncoding << body;
+}
+
+
+/*!
+	\class PyGoWave::FrameReplayer
+	\brief Feeds a recording of FrameRecorder into a Controller without network.
+
+	The inbound frames of the recording are processed by the Controller as if
+	they had been received from the message broker; outbound frames are only
+	used for timing. The Controller must be disconnected and should be freshly
+	constructed. It does not send any frames while replaying; wavelets the
+	recorded client had opened are routed on their first inbound frame.
+
+	By default frames are replayed as fast as possible; set realTime to replay
+	with the original timing.
+*/
+
+/*!
+	\fn void FrameReplayer::finished()
+
+	Fired after the last frame has been replayed.
+*/
+
+/*!
+	Constructs a FrameReplayer for the given \a controller.
+*/
+FrameReplayer::FrameReplayer(Controller * controller, QObject * parent) : QObject(parent), pd_ptr(new FrameReplayerPrivate(this))
+{
+	P_D(FrameReplayer);
+	d->m_controller = controller;
+	d->m_realTime = false;
+	d->m_next = 0;
+	d->m_replayed = 0;
+	d->m_dropped = 0;
+	d->m_startTime = 0;
+	d->m_totalApplyTime = 0;
+	d->m_frameApplyTime = Histogram(4096);
+}
+
+FrameReplayer::~FrameReplayer()
+{
+	delete this->pd_ptr;
+}
+
+/*!
+	Loads the recording from \a fileName. Returns false if the file cannot
+	be read or is not a recording.
+*/
+bool FrameReplayer::load(const QString &fileName)
+{
+	P_D(FrameReplayer);
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		qWarning("FrameReplayer: Cannot open '%s' for reading!", qPrintable(fileName));
+		return false;
+	}
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_4_5);
+	quint32 magic = 0, version = 0;
+	stream >> magic >> version;
+	if (magic != FrameRecorderPrivate::g_magic || version != FrameRecorderPrivate::g_version) {
+		qWarning("FrameReplayer: '%s' is not a frame recording!", qPrintable(fileName));
+		return false;
+	}
+	d->m_frames.clear();
+	while (!stream.atEnd()) {
+		RecordedFrame frame;
+		stream >> frame.offset >> frame.direction >> frame.type >> frame.destination >> frame.contentEncoding >> frame.body;
+		if (stream.status() != QDataStream::Ok) {
+			qWarning("FrameReplayer: Recording '%s' is truncated.", qPrintable(fileName));
+			break;
+		}
+		d->m_frames.append(frame);
+	}
+	d->m_next = 0;
+	return true;
+}
+
+/*!
+	Returns the number of recorded frames (inbound and outbound).
+*/
+int FrameReplayer::frameCount() const
+{
+	const P_D(FrameReplayer);
+	return d->m_frames.size();
+}
+
+/*!
+	\property FrameReplayer::realTime
+	\brief weather frames are replayed with their original timing.
+*/
+bool FrameReplayer::isRealTime() const
+{
+	const P_D(FrameReplayer);
+	return d->m_realTime;
+}
+void FrameReplayer::setRealTime(bool realTime)
+{
+	P_D(FrameReplayer);
+	d->m_realTime = realTime;
+}
+
+/*!
+	Starts the replay. In real time mode this returns immediately and
+	replays from the event loop, otherwise all frames are replayed before
+	returning. Fires finished() at the end.
+*/
+void FrameReplayer::start()
+{
+	P_D(FrameReplayer);
+	d->m_next = 0;
+	d->m_replayed = 0;
+	d->m_dropped = 0;
+	d->m_totalApplyTime = 0;
+	d->m_frameApplyTime.clear();
+	d->m_controller->pd_func()->beginReplay();
+	d->m_startTime = monotonicMicroseconds();
+	if (d->m_realTime)
+		d->scheduleNext();
+	else {
+		while (d->m_next < d->m_frames.size())
+			d->replayFrame(d->m_frames.at(d->m_next++));
+		emit finished();
+	}
+}
+
+/*!
+	Returns the number of inbound frames processed so far.
+*/
+int FrameReplayer::replayedFrames() const
+{
+	const P_D(FrameReplayer);
+	return d->m_replayed;
+}
+
+/*!
+	Returns the number of inbound frames the Controller could not route or
+	parse, e.g. frames of wavelets it does not know.
+*/
+int FrameReplayer::droppedFrames() const
+{
+	const P_D(FrameReplayer);
+	return d->m_dropped;
+}
+
+/*!
+	Returns the time in microseconds the Controller spent processing the
+	replayed frames, i.e. decoding and applying them to the model.
+*/
+quint64 FrameReplayer::totalApplyTime() const
+{
+	const P_D(FrameReplayer);
+	return d->m_totalApplyTime;
+}
+
+/*!
+	Returns the processing time per inbound frame in microseconds.
+*/
+Histogram FrameReplayer::frameApplyTime() const
+{
+	const P_D(FrameReplayer);
+	return d->m_frameApplyTime;
+}
+
+void FrameReplayerPrivate::replayFrame(const RecordedFrame &recorded)
+{
+	if (recorded.direction != FrameRecorder::Inbound)
+		return;
+	QStompResponseFrame frame((QStompResponseFrame::ResponseType) recorded.type);
+	frame.setDestination(recorded.destination);
+	if (!recorded.contentEncoding.isEmpty())
+		frame.setHeaderValue("content-encoding", recorded.contentEncoding);
+	frame.setRawBody(recorded.body);
+
+	ControllerPrivate * controller = this->m_controller->pd_func();
+	int dropped = controller->m_droppedFrames;
+	quint64 start = monotonicMicroseconds();
+	controller->processFrame(frame);
+	quint64 elapsed = monotonicMicroseconds() - start;
+	if (controller->m_droppedFrames != dropped)
+		this->m_dropped++;
+	this->m_totalApplyTime += elapsed;
+	this->m_frameApplyTime.addSample(elapsed);
+	this->m_replayed++;
+}
+
+void FrameReplayerPrivate::scheduleNext()
+{
+	P_Q(FrameReplayer);
+	if (this->m_next >= this->m_frames.size()) {
+		emit q->finished();
+		return;
+	}
+	qint64 due = this->m_frames.at(this->m_next).offset;
+	qint64 now = monotonicMicroseconds() - this->m_startTime;
+	QTimer::singleShot(due > now ? (int) ((due - now) / 1000) : 0, q, SLOT(_q_replayNext()));
+}
+
+void FrameReplayerPrivate::_q_replayNext()
+{
+	// Replay everything that is due, then wait for the next frame
+	qint64 now = monotonicMicroseconds() - this->m_startTime;
+	while (this->m_next < this->m_frames.size() && this->m_frames.at(this->m_next).offset <= now)
+		this->replayFrame(this->m_frames.at(this->m_next++));
+	this->scheduleNext();
+}
+
+#include "moc_recorder.cpp"
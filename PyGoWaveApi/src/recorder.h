@@ -0,0 +1,99 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "pygowave_api_global.h"
+
+#include "metrics.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+
+namespace PyGoWave {
+
+	class Controller;
+	class FrameRecorderPrivate;
+	class FrameReplayerPrivate;
+
+	class PYGOWAVE_API_SHARED_EXPORT FrameRecorder : public QObject
+	{
+		Q_OBJECT
+		P_DECLARE_PRIVATE(FrameRecorder)
+
+	public:
+		enum Direction {
+			Inbound = 0,
+			Outbound = 1
+		};
+
+		FrameRecorder(QObject * parent = 0);
+		~FrameRecorder();
+
+		bool open(const QString &fileName);
+		void close();
+		bool isOpen() const;
+
+		void recordFrame(Direction direction, int type, const QByteArray &destination, const QByteArray &contentEncoding, const QByteArray &body);
+
+	private:
+		Q_DISABLE_COPY(FrameRecorder)
+		FrameRecorderPrivate * const pd_ptr;
+	};
+
+	class PYGOWAVE_API_SHARED_EXPORT FrameReplayer : public QObject
+	{
+		Q_OBJECT
+		P_DECLARE_PRIVATE(FrameReplayer)
+
+	public:
+		FrameReplayer(Controller * controller, QObject * parent = 0);
+		~FrameReplayer();
+
+		bool load(const QString &fileName);
+		int frameCount() const;
+
+		bool isRealTime() const;
+		void setRealTime(bool realTime);
+
+		void start();
+
+		int replayedFrames() const;
+		int droppedFrames() const;
+		quint64 totalApplyTime() const;
+		Histogram frameApplyTime() const;
+
+	signals:
+		void finished();
+
+	private:
+		Q_DISABLE_COPY(FrameReplayer)
+		Q_PRIVATE_SLOT(pd_func(), void _q_replayNext())
+
+		FrameReplayerPrivate * const pd_ptr;
+	};
+}
+
+#ifdef PYGOWAVE_API_P_INCLUDE
+#  include "recorder_p.h"
+#endif
+
+#endif // RECORDER_H
@@ -0,0 +1,79 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDER_P_H
+#define RECORDER_P_H
+
+#include "pygowave_api_global.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QDataStream>
+#include <QtCore/QList>
+
+namespace PyGoWave {
+
+	class FrameRecorderPrivate
+	{
+	public:
+		QFile m_file;
+		QDataStream m_stream;
+		quint64 m_start;
+
+		static const quint32 g_magic;
+		static const quint32 g_version;
+	};
+
+	struct RecordedFrame
+	{
+		qint64 offset;
+		quint8 direction;
+		quint8 type;
+		QByteArray destination;
+		QByteArray contentEncoding;
+		QByteArray body;
+	};
+
+	class FrameReplayerPrivate
+	{
+		P_DECLARE_PUBLIC(FrameReplayer)
+	public:
+		FrameReplayerPrivate(FrameReplayer * q) : pq_ptr(q) {}
+
+		Controller * m_controller;
+		QList<RecordedFrame> m_frames;
+		bool m_realTime;
+		int m_next;
+		int m_replayed;
+		int m_dropped;
+		quint64 m_startTime;
+		quint64 m_totalApplyTime;
+		Histogram m_frameApplyTime;
+
+		void replayFrame(const RecordedFrame &frame);
+		void scheduleNext();
+
+		void _q_replayNext();
+
+	private:
+		FrameReplayer * const pq_ptr;
+	};
+}
+
+#endif // RECORDER_P_H
@@ -0,0 +1,277 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "loadclient.h"
+
+#include <PyGoWaveApi/controller.h>
+#include <PyGoWaveApi/model.h>
+
+#include <QtCore/QTimer>
+#include <QtCore/QCryptographicHash>
+
+using namespace PyGoWave;
+
+LoadOptions::LoadOptions()
+{
+	this->host = "localhost";
+	this->port = 61613;
+	this->userPrefix = "load";
+	this->password = "load";
+	this->clients = 10;
+	this->threads = 1;
+	this->waveletsPerClient = 3;
+	this->typingRate = 5.0;
+	this->elementRate = 0.1;
+	this->deltaRate = 0.5;
+	this->duration = 60;
+	this->settle = 5;
+	this->rampUp = 100;
+}
+
+LoadStats::LoadStats()
+{
+	this->online = false;
+	this->openedWavelets = 0;
+	this->textEdits = 0;
+	this->elementInserts = 0;
+	this->gadgetDeltas = 0;
+	this->inboundBundles = 0;
+	this->convergenceFailures = 0;
+	this->errors = 0;
+}
+
+LoadClient::LoadClient(const LoadOptions &options, int index, QObject * parent) : QObject(parent), m_options(options)
+{
+	this->m_index = index;
+	this->m_requestedWavelets = 0;
+	this->m_editing = true;
+
+	this->controller = new Controller(this);
+	this->controller->setObjectName("controller");
+	this->typingTimer = new QTimer(this);
+	this->typingTimer->setObjectName("typingTimer");
+	this->elementTimer = new QTimer(this);
+	this->elementTimer->setObjectName("elementTimer");
+	this->deltaTimer = new QTimer(this);
+	this->deltaTimer->setObjectName("deltaTimer");
+	QMetaObject::connectSlotsByName(this);
+}
+
+void LoadClient::start()
+{
+	this->controller->connectToHost(
+			this->m_options.host,
+			this->m_options.userPrefix + QString::number(this->m_index),
+			this->m_options.password,
+			this->m_options.port
+		);
+}
+
+/*
+ * Stops editing, so the wavelets can settle before they are compared.
+ */
+void LoadClient::stopEditing()
+{
+	this->m_editing = false;
+	this->typingTimer->stop();
+	this->elementTimer->stop();
+	this->deltaTimer->stop();
+}
+
+LoadStats LoadClient::stats() const
+{
+	LoadStats ret = this->m_stats;
+	ControllerMetrics metrics = this->controller->metrics();
+	ret.inboundBundles = metrics.inboundBundles.totalCount();
+	ret.ackLatencies = metrics.ackLatency.samples();
+	if (this->m_stats.online) {
+		foreach (QByteArray waveletId, this->m_openWavelets) {
+			Wavelet * wavelet = this->controller->wavelet(waveletId);
+			if (!wavelet)
+				continue;
+			QCryptographicHash digest(QCryptographicHash::Sha1);
+			digest.addData(QByteArray::number(wavelet->version()));
+			QList<QByteArray> blipIds = wavelet->allBlipIDs();
+			qSort(blipIds);
+			foreach (QByteArray blipId, blipIds) {
+				digest.addData(blipId);
+				digest.addData(wavelet->blipById(blipId)->content().toUtf8());
+			}
+			ret.waveletStates[waveletId] = digest.result();
+		}
+	}
+	return ret;
+}
+
+void LoadClient::on_controller_stateChanged(int state)
+{
+	this->m_stats.online = state == Controller::ClientOnline;
+	if (!this->m_stats.online) {
+		this->typingTimer->stop();
+		this->elementTimer->stop();
+		this->deltaTimer->stop();
+		this->m_openWavelets.clear();
+		this->m_requestedWavelets = 0;
+	}
+}
+
+void LoadClient::on_controller_waveAdded(const QByteArray &waveId, bool /*created*/, bool /*initial*/)
+{
+	if (this->m_requestedWavelets >= this->m_options.waveletsPerClient)
+		return;
+	WaveModel * wave = this->controller->wave(waveId);
+	if (!wave || !wave->rootWavelet())
+		return;
+	this->m_requestedWavelets++;
+	this->controller->openWavelet(wave->rootWavelet()->id());
+}
+
+void LoadClient::on_controller_waveletOpened(const QByteArray &waveletId, bool /*isRoot*/)
+{
+	if (this->m_openWavelets.contains(waveletId))
+		return;
+	this->m_openWavelets.append(waveletId);
+	this->m_stats.openedWavelets++;
+	connect(this->controller->wavelet(waveletId), SIGNAL(statusChange(QByteArray)), this, SLOT(waveletStatusChanged(QByteArray)));
+
+	if (this->m_openWavelets.size() == 1 && this->m_editing) {
+		this->startTimer(this->typingTimer, this->m_options.typingRate);
+		this->startTimer(this->elementTimer, this->m_options.elementRate);
+		this->startTimer(this->deltaTimer, this->m_options.deltaRate);
+	}
+}
+
+void LoadClient::on_controller_errorOccurred(const QByteArray &waveletId, const QString &tag, const QString &desc)
+{
+	qWarning("LoadClient %d: Error on %s: %s (%s)", this->m_index, waveletId.constData(), qPrintable(tag), qPrintable(desc));
+	this->m_stats.errors++;
+}
+
+void LoadClient::waveletStatusChanged(const QByteArray &status)
+{
+	if (status == "invalid")
+		this->m_stats.convergenceFailures++;
+}
+
+void LoadClient::startTimer(QTimer * timer, double rate)
+{
+	if (rate <= 0.0)
+		return;
+	timer->start(qMax(1, (int) (1000.0 / rate)));
+}
+
+bool LoadClient::pickBlip(QByteArray * waveletId, QByteArray * blipId)
+{
+	if (this->m_openWavelets.isEmpty())
+		return false;
+	*waveletId = this->m_openWavelets.at(qrand() % this->m_openWavelets.size());
+	Wavelet * wavelet = this->controller->wavelet(*waveletId);
+	if (!wavelet)
+		return false;
+	QList<QByteArray> blips = wavelet->allBlipIDs();
+	if (blips.isEmpty())
+		return false;
+	*blipId = blips.at(qrand() % blips.size());
+	return !blipId->startsWith("TBD_");
+}
+
+void LoadClient::on_typingTimer_timeout()
+{
+	QByteArray waveletId, blipId;
+	if (!this->pickBlip(&waveletId, &blipId))
+		return;
+	Blip * blip = this->controller->wavelet(waveletId)->blipById(blipId);
+	int index = qrand() % (blip->contentLength() + 1);
+	this->controller->textInserted(waveletId, blipId, index, QString(QChar('a' + qrand() % 26)));
+	this->m_stats.textEdits++;
+}
+
+void LoadClient::on_elementTimer_timeout()
+{
+	QByteArray waveletId, blipId;
+	if (!this->pickBlip(&waveletId, &blipId))
+		return;
+	Blip * blip = this->controller->wavelet(waveletId)->blipById(blipId);
+	int index = qrand() % (blip->contentLength() + 1);
+	QVariantMap properties;
+	properties["url"] = "http://mock/gadgets/1.xml";
+	this->controller->elementInsert(waveletId, blipId, index, Element::GADGET, properties);
+	this->m_stats.elementInserts++;
+}
+
+void LoadClient::on_deltaTimer_timeout()
+{
+	QByteArray waveletId, blipId;
+	if (!this->pickBlip(&waveletId, &blipId))
+		return;
+	Blip * blip = this->controller->wavelet(waveletId)->blipById(blipId);
+	foreach (Element * element, blip->allElements()) {
+		if (element->type() != Element::GADGET)
+			continue;
+		QVariantMap delta;
+		delta[QString("user%1").arg(this->m_index)] = QString::number(qrand());
+		this->controller->elementDeltaSubmitted(waveletId, blipId, element->position(), delta);
+		this->m_stats.gadgetDeltas++;
+		return;
+	}
+}
+
+
+LoadWorker::LoadWorker(const LoadOptions &options, int firstIndex, int count, QObject * parent) : QThread(parent), m_options(options)
+{
+	this->m_firstIndex = firstIndex;
+	this->m_count = count;
+}
+
+QList<LoadStats> LoadWorker::stats() const
+{
+	return this->m_stats;
+}
+
+void LoadWorker::run()
+{
+	qsrand(this->m_firstIndex + 1);
+
+	// All objects live in this thread
+	QList<LoadClient*> clients;
+	for (int i = 0; i < this->m_count; i++) {
+		LoadClient * client = new LoadClient(this->m_options, this->m_firstIndex + i);
+		clients.append(client);
+		QTimer::singleShot(i * this->m_options.rampUp, client, SLOT(start()));
+	}
+	// Edits stop after the duration; the wavelets are compared once the
+	// bundles still underway have been delivered
+	QTimer quietTimer;
+	quietTimer.setSingleShot(true);
+	foreach (LoadClient * client, clients)
+		connect(&quietTimer, SIGNAL(timeout()), client, SLOT(stopEditing()));
+	quietTimer.start(this->m_options.duration * 1000);
+	QTimer stopTimer;
+	stopTimer.setSingleShot(true);
+	connect(&stopTimer, SIGNAL(timeout()), this, SLOT(quit()), Qt::DirectConnection);
+	stopTimer.start((this->m_options.duration + this->m_options.settle) * 1000);
+
+	this->exec();
+
+	foreach (LoadClient * client, clients)
+		this->m_stats.append(client->stats());
+	qDeleteAll(clients);
+}
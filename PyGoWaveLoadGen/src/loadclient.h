@@ -0,0 +1,138 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+
+namespace PyGoWave {
+	class Controller;
+}
+class QTimer;
+
+struct LoadOptions
+{
+	LoadOptions();
+
+	QString host;
+	int port;
+	QString userPrefix;
+	QString password;
+	int clients;
+	int threads;
+	int waveletsPerClient;
+	double typingRate; // characters per second and client
+	double elementRate; // element inserts per second and client
+	double deltaRate; // gadget deltas per second and client
+	int duration; // seconds
+	int settle; // seconds without edits before the wavelets are compared
+	int rampUp; // ms between client logins
+};
+
+struct LoadStats
+{
+	LoadStats();
+
+	bool online;
+	int openedWavelets;
+	int textEdits;
+	int elementInserts;
+	int gadgetDeltas;
+	quint64 inboundBundles;
+	QVector<double> ackLatencies;
+	int convergenceFailures;
+	int errors;
+	QMap<QByteArray, QByteArray> waveletStates; // Digest of version and blip contents
+};
+
+/*
+ * One simulated user: a Controller which logs in, opens some wavelets and
+ * edits them at the configured rates.
+ */
+class LoadClient : public QObject
+{
+	Q_OBJECT
+
+public:
+	LoadClient(const LoadOptions &options, int index, QObject * parent = 0);
+
+	LoadStats stats() const;
+
+public slots:
+	void start();
+	void stopEditing();
+
+private slots:
+	void on_controller_stateChanged(int state);
+	void on_controller_waveAdded(const QByteArray &waveId, bool created, bool initial);
+	void on_controller_waveletOpened(const QByteArray &waveletId, bool isRoot);
+	void on_controller_errorOccurred(const QByteArray &waveletId, const QString &tag, const QString &desc);
+	void on_typingTimer_timeout();
+	void on_elementTimer_timeout();
+	void on_deltaTimer_timeout();
+	void waveletStatusChanged(const QByteArray &status);
+
+private:
+	void startTimer(QTimer * timer, double rate);
+	bool pickBlip(QByteArray * waveletId, QByteArray * blipId);
+
+	LoadOptions m_options;
+	int m_index;
+	PyGoWave::Controller * controller;
+	QTimer * typingTimer;
+	QTimer * elementTimer;
+	QTimer * deltaTimer;
+
+	QList<QByteArray> m_openWavelets;
+	int m_requestedWavelets;
+	bool m_editing;
+	LoadStats m_stats;
+};
+
+/*
+ * Runs a range of LoadClients in its own thread and event loop for the
+ * configured duration.
+ */
+class LoadWorker : public QThread
+{
+	Q_OBJECT
+
+public:
+	LoadWorker(const LoadOptions &options, int firstIndex, int count, QObject * parent = 0);
+
+	QList<LoadStats> stats() const;
+
+protected:
+	void run();
+
+private:
+	LoadOptions m_options;
+	int m_firstIndex;
+	int m_count;
+	QList<LoadStats> m_stats;
+};
+
+#endif // LOADCLIENT_H
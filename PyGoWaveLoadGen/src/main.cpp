@@ -0,0 +1,169 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include <PyGoWaveApi/metrics.h>
+
+#include "loadclient.h"
+
+using namespace PyGoWave;
+
+static void usage(QTextStream &out)
+{
+	out << "Usage: pygowave_loadgen [options]" << endl
+		<< "  --host <name>           STOMP server (localhost)" << endl
+		<< "  --port <n>              STOMP port (61613)" << endl
+		<< "  --user-prefix <text>    user names are <prefix><n> (load)" << endl
+		<< "  --password <text>       password of all users (load)" << endl
+		<< "  --clients <n>           number of simulated users (10)" << endl
+		<< "  --threads <n>           worker threads to spread them over (1)" << endl
+		<< "  --wavelets <n>          wavelets opened per user (3)" << endl
+		<< "  --typing <rate>         characters per second and user (5)" << endl
+		<< "  --elements <rate>       gadget inserts per second and user (0.1)" << endl
+		<< "  --deltas <rate>         gadget deltas per second and user (0.5)" << endl
+		<< "  --duration <s>          length of the run (60)" << endl
+		<< "  --settle <s>            quiet time before the wavelets are compared (5)" << endl
+		<< "  --ramp-up <ms>          delay between logins within a thread (100)" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QTextStream out(stdout);
+
+	LoadOptions options;
+	QStringList args = app.arguments();
+	for (int i = 1; i < args.size(); i++) {
+		QString arg = args.at(i);
+		if (i + 1 >= args.size()) {
+			usage(out);
+			return 1;
+		}
+		QString value = args.at(++i);
+		bool ok = true;
+		if (arg == "--host")
+			options.host = value;
+		else if (arg == "--port")
+			options.port = value.toInt(&ok);
+		else if (arg == "--user-prefix")
+			options.userPrefix = value;
+		else if (arg == "--password")
+			options.password = value;
+		else if (arg == "--clients")
+			options.clients = value.toInt(&ok);
+		else if (arg == "--threads")
+			options.threads = value.toInt(&ok);
+		else if (arg == "--wavelets")
+			options.waveletsPerClient = value.toInt(&ok);
+		else if (arg == "--typing")
+			options.typingRate = value.toDouble(&ok);
+		else if (arg == "--elements")
+			options.elementRate = value.toDouble(&ok);
+		else if (arg == "--deltas")
+			options.deltaRate = value.toDouble(&ok);
+		else if (arg == "--duration")
+			options.duration = value.toInt(&ok);
+		else if (arg == "--settle")
+			options.settle = value.toInt(&ok);
+		else if (arg == "--ramp-up")
+			options.rampUp = value.toInt(&ok);
+		else
+			ok = false;
+		if (!ok) {
+			usage(out);
+			return 1;
+		}
+	}
+	options.threads = qBound(1, options.threads, qMax(options.clients, 1));
+
+	out << "Running " << options.clients << " clients in " << options.threads << " threads against "
+		<< options.host << ":" << options.port << " for " << options.duration << " s..." << endl;
+
+	QList<LoadWorker*> workers;
+	int first = 0;
+	for (int t = 0; t < options.threads; t++) {
+		int count = options.clients / options.threads + (t < options.clients % options.threads ? 1 : 0);
+		workers.append(new LoadWorker(options, first, count));
+		first += count;
+	}
+	foreach (LoadWorker * worker, workers)
+		worker->start();
+	foreach (LoadWorker * worker, workers)
+		worker->wait();
+
+	LoadStats total;
+	int online = 0;
+	Histogram ackLatency(1 << 20);
+	QMap< QByteArray, QMap<QByteArray,int> > states; // Wavelet -> digest -> clients
+	foreach (LoadWorker * worker, workers) {
+		foreach (LoadStats stats, worker->stats()) {
+			if (stats.online)
+				online++;
+			total.openedWavelets += stats.openedWavelets;
+			total.textEdits += stats.textEdits;
+			total.elementInserts += stats.elementInserts;
+			total.gadgetDeltas += stats.gadgetDeltas;
+			total.inboundBundles += stats.inboundBundles;
+			total.convergenceFailures += stats.convergenceFailures;
+			total.errors += stats.errors;
+			foreach (double latency, stats.ackLatencies)
+				ackLatency.addSample(latency);
+			foreach (QByteArray waveletId, stats.waveletStates.keys())
+				states[waveletId][stats.waveletStates[waveletId]]++;
+		}
+	}
+	qDeleteAll(workers);
+
+	// Every client which does not share the most common state of a wavelet
+	// has failed to converge, whether the server noticed it or not
+	int invalid = total.convergenceFailures, diverged = 0, shared = 0;
+	foreach (QByteArray waveletId, states.keys()) {
+		const QMap<QByteArray,int> &digests = states[waveletId];
+		int clients = 0, agreeing = 0;
+		foreach (int count, digests) {
+			clients += count;
+			agreeing = qMax(agreeing, count);
+		}
+		if (clients > 1)
+			shared++;
+		diverged += clients - agreeing;
+	}
+	total.convergenceFailures += diverged;
+
+	double seconds = qMax(options.duration, 1);
+	int edits = total.textEdits + total.elementInserts + total.gadgetDeltas;
+	out << "Clients online:       " << online << "/" << options.clients << endl;
+	out << "Wavelets opened:      " << total.openedWavelets << endl;
+	out << "Edits:                " << edits << " (" << edits / seconds << "/s; "
+		<< total.textEdits << " text, " << total.elementInserts << " elements, " << total.gadgetDeltas << " deltas)" << endl;
+	out << "Inbound bundles:      " << total.inboundBundles << " (" << total.inboundBundles / seconds << "/s)" << endl;
+	out << "ACK latency (ms):     p50 " << ackLatency.percentile(50) << ", p90 " << ackLatency.percentile(90)
+		<< ", p99 " << ackLatency.percentile(99) << ", max " << ackLatency.maximum()
+		<< " (" << ackLatency.count() << " most recent samples)" << endl;
+	out << "Convergence failures: " << total.convergenceFailures << " (" << invalid << " reported invalid, "
+		<< diverged << " diverged replicas of " << shared << " shared wavelets)" << endl;
+	out << "Errors:               " << total.errors << endl;
+
+	return total.convergenceFailures > 0 ? 2 : 0;
+}
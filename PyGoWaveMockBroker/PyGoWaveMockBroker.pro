@@ -0,0 +1,39 @@
+#
+# This file is part of the PyGoWave Qt/C++ Client API
+#
+# Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+#
+# This library is free software: you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation, either
+# version 3 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General
+# Public License along with this library; see the file
+# COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+QT += network
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+LIBS += -lqjson
+macx:LIBS += -framework \
+    PyGoWaveApi
+else:win32:LIBS += -lpygowave_api0
+else:LIBS += -lpygowave_api
+TARGET = pygowave_mockbroker
+TEMPLATE = app
+DEPENDPATH += src
+INCLUDEPATH += src
+SOURCES += src/main.cpp \
+    src/mockbroker.cpp
+HEADERS += src/mockbroker.h
+target.path = $$[QT_INSTALL_BINS]
+INSTALLS += target
@@ -0,0 +1,102 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include "mockbroker.h"
+
+static void usage(QTextStream &out)
+{
+	out << "Usage: pygowave_mockbroker [options]" << endl
+		<< "  --port <n>            STOMP port to listen on (61613)" << endl
+		<< "  --waves <n>           number of synthetic waves (10)" << endl
+		<< "  --blips <n>           blips per synthetic wavelet (5)" << endl
+		<< "  --blip-size <n>       characters per synthetic blip (200)" << endl
+		<< "  --latency <ms>        delay of every outgoing frame (0)" << endl
+		<< "  --jitter <ms>         additional random delay (0)" << endl
+		<< "  --loss <percent>      drop this share of wave messages (0)" << endl
+		<< "  --reorder <percent>   deliver this share of wave messages late (0)" << endl
+		<< "  --compress <bytes>    deflate bodies from this size on, 0 disables (1024)" << endl
+		<< "  --seed <n>            random seed for reproducible runs (1)" << endl
+		<< "  --verbose             log every message" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QTextStream out(stdout);
+
+	MockBroker::Options options;
+	int port = 61613;
+	QStringList args = app.arguments();
+	for (int i = 1; i < args.size(); i++) {
+		QString arg = args.at(i);
+		if (arg == "--verbose") {
+			options.verbose = true;
+			continue;
+		}
+		if (i + 1 >= args.size()) {
+			usage(out);
+			return 1;
+		}
+		bool ok = false;
+		int value = args.at(++i).toInt(&ok);
+		if (!ok || value < 0) {
+			usage(out);
+			return 1;
+		}
+		if (arg == "--port")
+			port = value;
+		else if (arg == "--waves")
+			options.waves = value;
+		else if (arg == "--blips")
+			options.blipsPerWavelet = value;
+		else if (arg == "--blip-size")
+			options.blipSize = value;
+		else if (arg == "--latency")
+			options.latency = value;
+		else if (arg == "--jitter")
+			options.jitter = value;
+		else if (arg == "--loss")
+			options.lossPercent = value;
+		else if (arg == "--reorder")
+			options.reorderPercent = value;
+		else if (arg == "--compress")
+			options.compressionThreshold = value;
+		else if (arg == "--seed")
+			options.seed = (uint) value;
+		else {
+			usage(out);
+			return 1;
+		}
+	}
+
+	MockBroker broker(options);
+	if (!broker.listen((quint16) port)) {
+		out << "Cannot listen on port " << port << endl;
+		return 1;
+	}
+	out << "Mock broker listening on port " << port << " with " << options.waves << " synthetic waves" << endl;
+
+	return app.exec();
+}
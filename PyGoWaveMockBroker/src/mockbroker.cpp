@@ -0,0 +1,792 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "mockbroker.h"
+
+#include <PyGoWaveApi/operations.h>
+
+#include <qjson/parser.h>
+#include <qjson/serializer.h>
+
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtCore/QTimer>
+#include <QtCore/QDateTime>
+#include <QtCore/QUuid>
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtCore/QCryptographicHash>
+
+MockBroker::Options::Options()
+{
+	this->waves = 10;
+	this->blipsPerWavelet = 5;
+	this->blipSize = 200;
+	this->latency = 0;
+	this->jitter = 0;
+	this->lossPercent = 0;
+	this->reorderPercent = 0;
+	this->compressionThreshold = 1024;
+	this->seed = 1;
+	this->verbose = false;
+}
+
+MockBroker::MockBroker(const Options &options, QObject * parent) : QObject(parent), m_options(options)
+{
+	this->m_nextId = 1;
+	this->m_receivedBundles = 0;
+	qsrand(options.seed);
+
+	this->jparser = new QJson::Parser();
+	this->jserializer = new QJson::Serializer();
+
+	this->server = new QTcpServer(this);
+	this->server->setObjectName("server");
+	this->deliveryTimer = new QTimer(this);
+	this->deliveryTimer->setObjectName("deliveryTimer");
+	this->deliveryTimer->setSingleShot(true);
+	QMetaObject::connectSlotsByName(this);
+
+	this->m_participants.insert("mockbot@mock");
+	for (int i = 1; i <= options.waves; i++)
+		this->createWave(QString("Synthetic wave %1").arg(i), "mockbot@mock", options.blipsPerWavelet);
+}
+
+MockBroker::~MockBroker()
+{
+	delete this->jparser;
+	delete this->jserializer;
+	qDeleteAll(this->m_sessions);
+}
+
+bool MockBroker::listen(quint16 port)
+{
+	return this->server->listen(QHostAddress::Any, port);
+}
+
+quint64 MockBroker::receivedBundles() const
+{
+	return this->m_receivedBundles;
+}
+
+void MockBroker::on_server_newConnection()
+{
+	while (this->server->hasPendingConnections()) {
+		QTcpSocket * socket = this->server->nextPendingConnection();
+		Session * session = new Session;
+		session->socket = socket;
+		session->acceptsDeflate = false;
+		session->lastDue = 0;
+		this->m_sessions[socket] = session;
+		connect(socket, SIGNAL(readyRead()), this, SLOT(on_socket_readyRead()));
+		connect(socket, SIGNAL(disconnected()), this, SLOT(on_socket_disconnected()));
+		if (this->m_options.verbose)
+			qDebug("MockBroker: Connection from %s", qPrintable(socket->peerAddress().toString()));
+	}
+}
+
+void MockBroker::on_socket_disconnected()
+{
+	QTcpSocket * socket = qobject_cast<QTcpSocket*>(this->sender());
+	if (!socket || !this->m_sessions.contains(socket))
+		return;
+	if (this->m_options.verbose)
+		qDebug("MockBroker: %s disconnected", this->m_sessions[socket]->viewerId.constData());
+	delete this->m_sessions.take(socket);
+	socket->deleteLater();
+}
+
+void MockBroker::on_socket_readyRead()
+{
+	QTcpSocket * socket = qobject_cast<QTcpSocket*>(this->sender());
+	if (!socket || !this->m_sessions.contains(socket))
+		return;
+	Session * session = this->m_sessions[socket];
+	session->buffer.append(socket->readAll());
+	Frame frame;
+	while (this->parseFrame(session, &frame)) {
+		this->processFrame(session, frame);
+		if (!this->m_sessions.contains(socket))
+			return; // Closed while processing
+	}
+}
+
+bool MockBroker::parseFrame(Session * session, Frame * frame)
+{
+	QByteArray &buf = session->buffer;
+
+	// Skip heart-beats and the line breaks between frames
+	int start = 0;
+	while (start < buf.size() && (buf.at(start) == '\n' || buf.at(start) == '\r'))
+		start++;
+	buf.remove(0, start);
+
+	int headerEnd = buf.indexOf("\n\n");
+	if (headerEnd == -1)
+		return false;
+
+	QList<QByteArray> lines = buf.left(headerEnd).split('\n');
+	frame->command = lines.takeFirst().trimmed();
+	frame->headers.clear();
+	foreach (QByteArray line, lines) {
+		int colon = line.indexOf(':');
+		if (colon > 0)
+			frame->headers[line.left(colon).trimmed()] = line.mid(colon + 1).trimmed();
+	}
+
+	int bodyStart = headerEnd + 2;
+	int bodyEnd;
+	if (frame->headers.contains("content-length")) {
+		bodyEnd = bodyStart + frame->headers["content-length"].toInt();
+		if (buf.size() < bodyEnd + 1)
+			return false;
+	}
+	else {
+		bodyEnd = buf.indexOf('\0', bodyStart);
+		if (bodyEnd == -1)
+			return false;
+	}
+	frame->body = buf.mid(bodyStart, bodyEnd - bodyStart);
+	buf.remove(0, bodyEnd + 1);
+	return true;
+}
+
+void MockBroker::processFrame(Session * session, const Frame &frame)
+{
+	QMap<QByteArray, QByteArray> headers;
+	if (frame.command == "CONNECT") {
+		headers["session"] = MockBroker::newKey();
+		this->sendFrame(session, "CONNECTED", headers, QByteArray(), false);
+	}
+	else if (frame.command == "SUBSCRIBE")
+		session->subscriptions.insert(frame.headers["destination"]);
+	else if (frame.command == "UNSUBSCRIBE")
+		session->subscriptions.remove(frame.headers["destination"]);
+	else if (frame.command == "DISCONNECT") {
+		session->socket->disconnectFromHost();
+		return;
+	}
+	else if (frame.command == "SEND") {
+		QList<QByteArray> routing_key = frame.headers["destination"].split('.');
+		if (routing_key.size() != 3 || routing_key[2] != "clientop") {
+			qWarning("MockBroker: Malformed routing key '%s'!", frame.headers["destination"].constData());
+			return;
+		}
+		QByteArray target = routing_key[1];
+		if (target == "login")
+			session->rxKey = routing_key[0];
+		else if (routing_key[0] != session->txKey) {
+			qWarning("MockBroker: Unknown access key '%s'!", routing_key[0].constData());
+			return;
+		}
+
+		QByteArray body = frame.body;
+		if (frame.headers["content-encoding"] == "deflate")
+			body = MockBroker::inflate(body);
+		bool ok = false;
+		QVariant msgs = this->jparser->parse(body, &ok);
+		if (!ok) {
+			qWarning("MockBroker: Error in parsing received JSON data!");
+			return;
+		}
+		QVariantList msgList = msgs.type() == QVariant::List ? msgs.toList() : QVariantList() << msgs;
+		foreach (QVariant vmsg, msgList) {
+			QVariantMap msg = vmsg.toMap();
+			this->processMessage(session, target, msg["type"].toString(), msg["property"]);
+		}
+	}
+
+	if (frame.headers.contains("receipt")) {
+		headers.clear();
+		headers["receipt-id"] = frame.headers["receipt"];
+		this->sendFrame(session, "RECEIPT", headers, QByteArray(), false);
+	}
+}
+
+void MockBroker::processMessage(Session * session, const QByteArray &target, const QString &type, const QVariant &property)
+{
+	if (this->m_options.verbose)
+		qDebug("MockBroker: %s on %s from %s", qPrintable(type), target.constData(), session->viewerId.constData());
+
+	if (target == "login") {
+		if (type != "LOGIN")
+			return;
+		QVariantMap propertyMap = property.toMap();
+		QString username = propertyMap["username"].toString().toLower().replace(QRegExp("[^a-z0-9_-]"), "");
+		if (username.isEmpty()) {
+			QVariantMap error;
+			error["tag"] = "INVALID_LOGIN";
+			error["desc"] = "Empty user name";
+			this->sendMessage(session, "login", "ERROR", error);
+			return;
+		}
+		session->viewerId = username.toAscii() + "@mock";
+		session->acceptsDeflate = propertyMap["accept_encoding"].toStringList().contains("deflate");
+		this->m_participants.insert(session->viewerId);
+
+		// Every user may see every synthetic wave
+		QMap<QByteArray, WaveletData>::iterator it;
+		for (it = this->m_wavelets.begin(); it != this->m_wavelets.end(); ++it) {
+			if (it.value().creator == "mockbot@mock" && !it.value().participants.contains(session->viewerId))
+				it.value().participants.append(session->viewerId);
+		}
+
+		QVariantMap reply;
+		QByteArray rxKey = MockBroker::newKey(), txKey = MockBroker::newKey();
+		reply["rx_key"] = QString::fromAscii(rxKey);
+		reply["tx_key"] = QString::fromAscii(txKey);
+		reply["viewer_id"] = QString::fromAscii(session->viewerId);
+		if (session->acceptsDeflate && this->m_options.compressionThreshold > 0)
+			reply["content_encoding"] = QVariantList() << QString("deflate");
+		this->sendMessage(session, "login", "LOGIN", reply);
+		session->rxKey = rxKey;
+		session->txKey = txKey;
+		return;
+	}
+
+	if (target == "manager") {
+		if (type == "WAVE_LIST") {
+			QVariantMap waves;
+			foreach (QByteArray waveId, this->m_waves.keys()) {
+				QVariantMap wavelets = this->waveletDictsOfWave(waveId, session->viewerId);
+				if (!wavelets.isEmpty())
+					waves[QString::fromAscii(waveId)] = wavelets;
+			}
+			this->sendMessage(session, "manager", "WAVE_LIST", waves);
+		}
+		else if (type == "WAVELET_LIST") {
+			QByteArray waveId = property.toMap()["waveId"].toByteArray();
+			QVariantMap reply;
+			reply["waveId"] = QString::fromAscii(waveId);
+			reply["wavelets"] = this->waveletDictsOfWave(waveId, session->viewerId);
+			this->sendMessage(session, "manager", "WAVELET_LIST", reply);
+		}
+		else if (type == "PARTICIPANT_INFO") {
+			QVariantMap reply;
+			foreach (QVariant id, property.toList())
+				reply[id.toString()] = this->participantDict(id.toByteArray());
+			this->sendMessage(session, "manager", "PARTICIPANT_INFO", reply);
+		}
+		else if (type == "PARTICIPANT_SEARCH") {
+			QString text = property.toString().toLower();
+			QVariantMap reply;
+			if (text.length() < 3) {
+				reply["result"] = "TOO_SHORT";
+				reply["data"] = 3;
+			}
+			else {
+				QVariantList ids;
+				foreach (QByteArray id, this->m_participants) {
+					if (QString::fromAscii(id).contains(text))
+						ids << QString::fromAscii(id);
+				}
+				reply["result"] = "OK";
+				reply["data"] = ids;
+			}
+			this->sendMessage(session, "manager", "PARTICIPANT_SEARCH", reply);
+		}
+		else if (type == "GADGET_LIST") {
+			QVariantList gadgets;
+			for (int i = 1; i <= 3; i++) {
+				QVariantMap gadget;
+				gadget["id"] = i;
+				gadget["name"] = QString("Mock gadget %1").arg(i);
+				gadget["descr"] = "Synthetic gadget of the mock broker";
+				gadget["url"] = QString("http://mock/gadgets/%1.xml").arg(i);
+				gadget["uploaded_by"] = "mockbot";
+				gadgets << gadget;
+			}
+			this->sendMessage(session, "manager", "GADGET_LIST", gadgets);
+		}
+		else if (type == "PING")
+			this->sendMessage(session, "manager", "PONG", property);
+		else if (type == "WAVELET_CREATE") {
+			QVariantMap propertyMap = property.toMap();
+			QByteArray waveId = propertyMap["waveId"].toByteArray();
+			QString title = propertyMap["title"].toString();
+			QByteArray waveletId;
+			if (waveId.isEmpty() || !this->m_waves.contains(waveId)) {
+				waveId = QString("wave%1").arg(this->m_nextId++).toAscii();
+				waveletId = this->createWavelet(waveId, title, session->viewerId, true, 1);
+			}
+			else
+				waveletId = this->createWavelet(waveId, title, session->viewerId, false, 1);
+			QVariantMap reply;
+			reply["waveId"] = QString::fromAscii(waveId);
+			reply["waveletId"] = QString::fromAscii(waveletId);
+			this->sendMessage(session, "manager", "WAVELET_CREATED", reply);
+		}
+		return;
+	}
+
+	// Wavelet messages
+	if (!this->m_wavelets.contains(target)) {
+		QVariantMap error;
+		error["tag"] = "WAVELET_NOT_FOUND";
+		error["desc"] = QString("Wavelet '%1' does not exist").arg(QString::fromAscii(target));
+		this->sendMessage(session, target, "ERROR", error);
+		return;
+	}
+	WaveletData &wavelet = this->m_wavelets[target];
+	if (type == "WAVELET_OPEN") {
+		QVariantMap propertyMap = property.toMap();
+		if (propertyMap.contains("version") && propertyMap["version"].toInt() == wavelet.version) {
+			QVariantMap reply;
+			reply["wavelet"] = this->waveletDict(wavelet);
+			reply["unchanged"] = true;
+			this->sendMessage(session, target, "WAVELET_OPEN", reply);
+			return;
+		}
+		QVariantMap blips;
+		foreach (QByteArray blipId, wavelet.blips.keys()) {
+			const BlipData &blip = wavelet.blips[blipId];
+			QVariantMap blipDict;
+			blipDict["id"] = QString::fromAscii(blipId);
+			blipDict["content"] = blip.content;
+			blipDict["elements"] = blip.elements;
+			blipDict["contributors"] = blip.contributors;
+			blipDict["creator"] = QString::fromAscii(blip.creator);
+			blipDict["creationTime"] = blip.creationTime;
+			blipDict["lastModifiedTime"] = blip.lastModifiedTime;
+			blipDict["version"] = blip.version;
+			blipDict["submitted"] = true;
+			blips[QString::fromAscii(blipId)] = blipDict;
+		}
+		QVariantMap reply;
+		reply["wavelet"] = this->waveletDict(wavelet);
+		reply["blips"] = blips;
+		this->sendMessage(session, target, "WAVELET_OPEN", reply);
+	}
+	else if (type == "OPERATION_MESSAGE_BUNDLE")
+		this->processBundle(session, wavelet, property.toMap());
+}
+
+void MockBroker::processBundle(Session * session, WaveletData &wavelet, const QVariantMap &bundle)
+{
+	this->m_receivedBundles++;
+	quint64 ts = MockBroker::timestamp();
+	int version = bundle["version"].toInt();
+	if (version < 0 || version > wavelet.version) {
+		QVariantMap error;
+		error["tag"] = "INVALID_VERSION";
+		error["desc"] = QString("Wavelet '%1' has no version %2").arg(QString::fromAscii(wavelet.id)).arg(version);
+		this->sendMessage(session, wavelet.id, "ERROR", error);
+		return;
+	}
+
+	QVariantMap newBlips;
+	QVariantList applied;
+	foreach (QVariant vop, this->transformBundle(wavelet, bundle["operations"].toList(), version, session->viewerId)) {
+		QVariantMap op = vop.toMap();
+		if (this->applyOperation(wavelet, op, session->viewerId, ts, newBlips))
+			applied << op;
+	}
+	wavelet.history.append(applied);
+	wavelet.version++;
+	wavelet.lastModifiedTime = ts / 1000llu;
+
+	QVariantMap sums = this->blipsums(wavelet);
+
+	QVariantMap ack;
+	ack["version"] = wavelet.version;
+	ack["blipsums"] = sums;
+	ack["timestamp"] = ts;
+	ack["contributor"] = QString::fromAscii(session->viewerId);
+	ack["newblips"] = newBlips;
+	this->sendMessage(session, wavelet.id, "OPERATION_MESSAGE_BUNDLE_ACK", ack);
+
+	QVariantMap delta;
+	delta["version"] = wavelet.version;
+	delta["operations"] = applied;
+	delta["blipsums"] = sums;
+	delta["timestamp"] = ts;
+	delta["contributor"] = QString::fromAscii(session->viewerId);
+	this->broadcast(wavelet.id, session, "OPERATION_MESSAGE_BUNDLE", delta);
+}
+
+/*
+ * Transforms the operations of a bundle based on \a version against all
+ * operations applied since, like the PyGoWave server does. The applied
+ * operations win ties, as they do when the clients transform them against
+ * their own pending operations.
+ */
+QVariantList MockBroker::transformBundle(const WaveletData &wavelet, const QVariantList &operations, int version, const QByteArray &contributor) const
+{
+	if (version == wavelet.version)
+		return operations;
+	PyGoWave::OpManager incoming(wavelet.waveId, wavelet.id, contributor);
+	incoming.unserialize(operations);
+	for (int v = version; v < wavelet.version; v++) {
+		foreach (QVariant vop, wavelet.history.at(v)) {
+			PyGoWave::Operation * op = PyGoWave::Operation::unserialize(vop.toMap());
+			qDeleteAll(incoming.transform(op)); // Transforms the incoming operations in place
+			delete op;
+		}
+	}
+	return incoming.serialize(true);
+}
+
+bool MockBroker::applyOperation(WaveletData &wavelet, QVariantMap &op, const QByteArray &contributor, quint64 timestamp, QVariantMap &newBlips)
+{
+	QString type = op["type"].toString();
+	QByteArray blipId = op["blipId"].toByteArray();
+	if (newBlips.contains(blipId)) {
+		blipId = newBlips[blipId].toByteArray();
+		op["blipId"] = QString::fromAscii(blipId);
+	}
+	int index = op["index"].toInt();
+
+	if (type == "WAVELET_APPEND_BLIP") {
+		QVariantMap property = op["property"].toMap();
+		QByteArray newId = QString("blip%1").arg(this->m_nextId++).toAscii();
+		newBlips[property["blipId"].toString()] = QString::fromAscii(newId);
+		property["blipId"] = QString::fromAscii(newId);
+		op["property"] = property;
+		BlipData blip;
+		blip.creator = contributor;
+		blip.contributors << QString::fromAscii(contributor);
+		blip.creationTime = timestamp;
+		blip.lastModifiedTime = timestamp;
+		blip.version = 0;
+		wavelet.blips[newId] = blip;
+		return true;
+	}
+	if (type == "WAVELET_ADD_PARTICIPANT") {
+		QByteArray id = op["property"].toByteArray();
+		if (!wavelet.participants.contains(id)) {
+			wavelet.participants.append(id);
+			this->m_participants.insert(id);
+			QVariantMap notice;
+			notice["id"] = QString::fromAscii(id);
+			notice["waveId"] = QString::fromAscii(wavelet.waveId);
+			notice["waveletId"] = QString::fromAscii(wavelet.id);
+			foreach (Session * other, this->m_sessions) {
+				if (other->viewerId == id)
+					this->sendMessage(other, "manager", "WAVELET_ADD_PARTICIPANT", notice);
+			}
+		}
+		return true;
+	}
+	if (type == "WAVELET_REMOVE_PARTICIPANT") {
+		wavelet.participants.removeAll(op["property"].toByteArray());
+		return true;
+	}
+
+	if (!wavelet.blips.contains(blipId))
+		return false;
+	BlipData &blip = wavelet.blips[blipId];
+	index = qBound(0, index, blip.content.length());
+	int shiftFrom = -1, shift = 0;
+
+	if (type == "BLIP_DELETE") {
+		wavelet.blips.remove(blipId);
+		return true;
+	}
+	else if (type == "DOCUMENT_INSERT") {
+		QString text = op["property"].toString();
+		blip.content.insert(index, text);
+		shiftFrom = index;
+		shift = text.length();
+	}
+	else if (type == "DOCUMENT_DELETE") {
+		int length = qMin(op["property"].toInt(), blip.content.length() - index);
+		blip.content.remove(index, length);
+		shiftFrom = index + length;
+		shift = -length;
+	}
+	else if (type == "DOCUMENT_ELEMENT_INSERT") {
+		QVariantMap property = op["property"].toMap();
+		blip.content.insert(index, "\n");
+		for (int i = 0; i < blip.elements.size(); i++) {
+			QVariantMap element = blip.elements[i].toMap();
+			if (element["index"].toInt() >= index) {
+				element["index"] = element["index"].toInt() + 1;
+				blip.elements[i] = element;
+			}
+		}
+		QVariantMap element;
+		element["id"] = this->m_nextId++;
+		element["index"] = index;
+		element["type"] = property["type"];
+		element["properties"] = property["properties"];
+		blip.elements << element;
+	}
+	else if (type == "DOCUMENT_ELEMENT_DELETE") {
+		for (int i = 0; i < blip.elements.size(); i++) {
+			if (blip.elements[i].toMap()["index"].toInt() == index) {
+				blip.elements.removeAt(i);
+				blip.content.remove(index, 1);
+				shiftFrom = index + 1;
+				shift = -1;
+				break;
+			}
+		}
+	}
+	else if (type == "DOCUMENT_ELEMENT_DELTA" || type == "DOCUMENT_ELEMENT_SETPREF") {
+		for (int i = 0; i < blip.elements.size(); i++) {
+			QVariantMap element = blip.elements[i].toMap();
+			if (element["index"].toInt() != index)
+				continue;
+			QVariantMap properties = element["properties"].toMap();
+			QVariantMap property = op["property"].toMap();
+			if (type == "DOCUMENT_ELEMENT_DELTA") {
+				QVariantMap fields = properties["fields"].toMap();
+				foreach (QString key, property.keys()) {
+					if (property[key].isNull())
+						fields.remove(key);
+					else
+						fields[key] = property[key];
+				}
+				properties["fields"] = fields;
+			}
+			else {
+				QVariantMap userprefs = properties["userprefs"].toMap();
+				userprefs[property["key"].toString()] = property["value"];
+				properties["userprefs"] = userprefs;
+			}
+			element["properties"] = properties;
+			blip.elements[i] = element;
+			break;
+		}
+	}
+
+	if (shift != 0) {
+		for (int i = 0; i < blip.elements.size(); i++) {
+			QVariantMap element = blip.elements[i].toMap();
+			if (element["index"].toInt() >= shiftFrom) {
+				element["index"] = element["index"].toInt() + shift;
+				blip.elements[i] = element;
+			}
+		}
+	}
+	if (!blip.contributors.contains(QString::fromAscii(contributor)))
+		blip.contributors << QString::fromAscii(contributor);
+	blip.lastModifiedTime = timestamp;
+	blip.version++;
+	return true;
+}
+
+void MockBroker::sendFrame(Session * session, const QByteArray &command, const QMap<QByteArray, QByteArray> &headers, const QByteArray &body, bool lossy)
+{
+	if (lossy && this->m_options.lossPercent > 0 && qrand() % 100 < this->m_options.lossPercent) {
+		if (this->m_options.verbose)
+			qDebug("MockBroker: Dropped frame to %s", session->viewerId.constData());
+		return;
+	}
+
+	QByteArray data = command + "\n";
+	QMap<QByteArray, QByteArray>::const_iterator it;
+	for (it = headers.constBegin(); it != headers.constEnd(); ++it)
+		data += it.key() + ":" + it.value() + "\n";
+	data += "\n" + body;
+	data.append('\0');
+
+	qint64 now = (qint64) MockBroker::timestamp();
+	qint64 due = now + this->m_options.latency;
+	if (this->m_options.jitter > 0)
+		due += qrand() % (this->m_options.jitter + 1);
+	if (lossy && this->m_options.reorderPercent > 0 && qrand() % 100 < this->m_options.reorderPercent)
+		due += this->m_options.latency + this->m_options.jitter + 50; // Let later frames overtake this one
+	else
+		due = qMax(due, session->lastDue); // Keep the order otherwise
+	session->lastDue = qMax(session->lastDue, due);
+
+	if (due <= now && this->m_deliveries.isEmpty()) {
+		session->socket->write(data);
+		return;
+	}
+	Delivery delivery;
+	delivery.socket = session->socket;
+	delivery.data = data;
+	this->m_deliveries.insert(qMakePair(due, this->m_nextId++), delivery);
+	this->deliveryTimer->start(qMax(0, (int) (this->m_deliveries.constBegin().key().first - now)));
+}
+
+void MockBroker::on_deliveryTimer_timeout()
+{
+	qint64 now = (qint64) MockBroker::timestamp();
+	while (!this->m_deliveries.isEmpty() && this->m_deliveries.constBegin().key().first <= now) {
+		Delivery delivery = this->m_deliveries.take(this->m_deliveries.constBegin().key());
+		if (!delivery.socket.isNull())
+			delivery.socket->write(delivery.data);
+	}
+	if (!this->m_deliveries.isEmpty())
+		this->deliveryTimer->start(qMax(0, (int) (this->m_deliveries.constBegin().key().first - now)));
+}
+
+void MockBroker::sendMessages(Session * session, const QByteArray &target, const QVariantList &messages)
+{
+	QByteArray destination = session->rxKey + "." + target + ".waveop";
+	if (!session->subscriptions.contains(destination))
+		return; // Nobody listens; the exchange would discard the message
+
+	QMap<QByteArray, QByteArray> headers;
+	QByteArray body = this->jserializer->serialize(messages);
+	if (session->acceptsDeflate && this->m_options.compressionThreshold > 0 && body.size() >= this->m_options.compressionThreshold) {
+		QByteArray compressed = MockBroker::deflate(body);
+		if (compressed.size() < body.size()) {
+			headers["content-encoding"] = "deflate";
+			body = compressed;
+		}
+	}
+	headers["destination"] = destination;
+	headers["message-id"] = QByteArray::number(this->m_nextId++);
+	headers["content-type"] = "application/json";
+	headers["content-length"] = QByteArray::number(body.size());
+	this->sendFrame(session, "MESSAGE", headers, body, target != "login");
+}
+
+void MockBroker::sendMessage(Session * session, const QByteArray &target, const QString &type, const QVariant &property)
+{
+	QVariantMap msg;
+	msg["type"] = type;
+	msg["property"] = property;
+	this->sendMessages(session, target, QVariantList() << msg);
+}
+
+void MockBroker::broadcast(const QByteArray &waveletId, Session * except, const QString &type, const QVariant &property)
+{
+	foreach (Session * session, this->m_sessions) {
+		if (session != except)
+			this->sendMessage(session, waveletId, type, property);
+	}
+}
+
+void MockBroker::createWave(const QString &title, const QByteArray &creator, int blips)
+{
+	QByteArray waveId = QString("wave%1").arg(this->m_nextId++).toAscii();
+	this->createWavelet(waveId, title, creator, true, blips);
+}
+
+QByteArray MockBroker::createWavelet(const QByteArray &waveId, const QString &title, const QByteArray &creator, bool isRoot, int blips)
+{
+	static const char * words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "wave", "blip", "gadget", "delta", "version"};
+
+	WaveletData wavelet;
+	wavelet.id = QString("wavelet%1").arg(this->m_nextId++).toAscii();
+	wavelet.waveId = waveId;
+	wavelet.title = title;
+	wavelet.creator = creator;
+	wavelet.isRoot = isRoot;
+	wavelet.participants << creator;
+	wavelet.creationTime = QDateTime::currentDateTime().toTime_t();
+	wavelet.lastModifiedTime = wavelet.creationTime;
+	wavelet.version = 0;
+
+	quint64 ts = MockBroker::timestamp();
+	for (int i = 0; i < qMax(blips, 1); i++) {
+		BlipData blip;
+		while (blip.content.length() < this->m_options.blipSize)
+			blip.content += QString::fromAscii(words[qrand() % 10]) + " ";
+		blip.content.truncate(this->m_options.blipSize);
+		blip.creator = creator;
+		blip.contributors << QString::fromAscii(creator);
+		blip.creationTime = ts + i;
+		blip.lastModifiedTime = ts + i;
+		blip.version = 0;
+		QByteArray blipId = QString("blip%1").arg(this->m_nextId++).toAscii();
+		if (i == 0)
+			wavelet.rootBlipId = blipId;
+		wavelet.blips[blipId] = blip;
+	}
+
+	this->m_waves[waveId].append(wavelet.id);
+	this->m_wavelets[wavelet.id] = wavelet;
+	return wavelet.id;
+}
+
+QVariantMap MockBroker::waveletDict(const WaveletData &wavelet) const
+{
+	QVariantList participants;
+	foreach (QByteArray id, wavelet.participants)
+		participants << QString::fromAscii(id);
+	QVariantMap ret;
+	ret["id"] = QString::fromAscii(wavelet.id);
+	ret["waveId"] = QString::fromAscii(wavelet.waveId);
+	ret["title"] = wavelet.title;
+	ret["creator"] = QString::fromAscii(wavelet.creator);
+	ret["isRoot"] = wavelet.isRoot;
+	ret["participants"] = participants;
+	ret["creationTime"] = wavelet.creationTime;
+	ret["lastModifiedTime"] = wavelet.lastModifiedTime;
+	ret["version"] = wavelet.version;
+	ret["rootBlipId"] = QString::fromAscii(wavelet.rootBlipId);
+	return ret;
+}
+
+QVariantMap MockBroker::waveletDictsOfWave(const QByteArray &waveId, const QByteArray &viewerId) const
+{
+	QVariantMap ret;
+	foreach (QByteArray waveletId, this->m_waves.value(waveId)) {
+		const WaveletData &wavelet = this->m_wavelets[waveletId];
+		if (wavelet.participants.contains(viewerId))
+			ret[QString::fromAscii(waveletId)] = this->waveletDict(wavelet);
+	}
+	return ret;
+}
+
+QVariantMap MockBroker::participantDict(const QByteArray &id) const
+{
+	QVariantMap ret;
+	ret["id"] = QString::fromAscii(id);
+	ret["displayName"] = QString::fromAscii(id.left(id.indexOf('@')));
+	ret["thumbnailUrl"] = "";
+	ret["profileUrl"] = "";
+	ret["isBot"] = id == "mockbot@mock";
+	return ret;
+}
+
+QVariantMap MockBroker::blipsums(const WaveletData &wavelet) const
+{
+	QVariantMap ret;
+	foreach (QByteArray blipId, wavelet.blips.keys())
+		ret[QString::fromAscii(blipId)] = QString::fromAscii(QCryptographicHash::hash(wavelet.blips[blipId].content.toUtf8(), QCryptographicHash::Sha1).toHex());
+	return ret;
+}
+
+QByteArray MockBroker::deflate(const QByteArray &data)
+{
+	// Same wire format as PyGoWave::Controller: a zlib stream without qCompress' size prefix
+	return qCompress(data).mid(4);
+}
+
+QByteArray MockBroker::inflate(const QByteArray &data)
+{
+	QByteArray input;
+	quint32 hint = (quint32) data.size() * 4;
+	input.append((char) ((hint >> 24) & 0xff));
+	input.append((char) ((hint >> 16) & 0xff));
+	input.append((char) ((hint >> 8) & 0xff));
+	input.append((char) (hint & 0xff));
+	input.append(data);
+	return qUncompress(input);
+}
+
+quint64 MockBroker::timestamp()
+{
+	QDateTime now = QDateTime::currentDateTime().toUTC();
+	return now.toTime_t() * 1000llu + now.time().msec();
+}
+
+QByteArray MockBroker::newKey()
+{
+	return QUuid::createUuid().toString().replace(QRegExp("\\{|\\}"), "").toAscii();
+}
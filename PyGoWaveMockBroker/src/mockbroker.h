@@ -0,0 +1,177 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MOCKBROKER_H
+#define MOCKBROKER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QMap>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QVariant>
+#include <QtCore/QPointer>
+#include <QtCore/QPair>
+
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+
+namespace QJson {
+	class Serializer;
+	class Parser;
+}
+
+/*
+ * A STOMP 1.0 stand-in for RabbitMQ plus the PyGoWave server.
+ *
+ * Implements the login/manager/waveop routing used by PyGoWave::Controller
+ * on a set of synthetic waves. Operation bundles are applied in arrival order,
+ * after transforming those based on an older version against the operations
+ * applied since, and acknowledged with increasing versions. Outgoing messages
+ * can be delayed, dropped and reordered.
+ */
+class MockBroker : public QObject
+{
+	Q_OBJECT
+
+public:
+	struct Options
+	{
+		Options();
+
+		int waves;
+		int blipsPerWavelet;
+		int blipSize;
+		int latency; // ms
+		int jitter; // ms
+		int lossPercent;
+		int reorderPercent;
+		int compressionThreshold; // bytes, 0 disables
+		uint seed;
+		bool verbose;
+	};
+
+	MockBroker(const Options &options, QObject * parent = 0);
+	~MockBroker();
+
+	bool listen(quint16 port);
+
+	quint64 receivedBundles() const;
+
+private slots:
+	void on_server_newConnection();
+	void on_socket_readyRead();
+	void on_socket_disconnected();
+	void on_deliveryTimer_timeout();
+
+private:
+	struct Frame
+	{
+		QByteArray command;
+		QMap<QByteArray, QByteArray> headers;
+		QByteArray body;
+	};
+
+	struct Session
+	{
+		QTcpSocket * socket;
+		QByteArray buffer;
+		QSet<QByteArray> subscriptions;
+		QByteArray rxKey;
+		QByteArray txKey;
+		QByteArray viewerId;
+		bool acceptsDeflate;
+		qint64 lastDue;
+	};
+
+	struct BlipData
+	{
+		QString content;
+		QVariantList elements;
+		QVariantList contributors;
+		QByteArray creator;
+		quint64 creationTime;
+		quint64 lastModifiedTime;
+		int version;
+	};
+
+	struct WaveletData
+	{
+		QByteArray id;
+		QByteArray waveId;
+		QString title;
+		QByteArray creator;
+		bool isRoot;
+		QList<QByteArray> participants;
+		uint creationTime;
+		uint lastModifiedTime;
+		int version;
+		QByteArray rootBlipId;
+		QMap<QByteArray, BlipData> blips;
+		QList<QVariantList> history; // Applied operations, history[i] led to version i+1
+	};
+
+	struct Delivery
+	{
+		QPointer<QTcpSocket> socket;
+		QByteArray data;
+	};
+
+	bool parseFrame(Session * session, Frame * frame);
+	void processFrame(Session * session, const Frame &frame);
+	void processMessage(Session * session, const QByteArray &target, const QString &type, const QVariant &property);
+	void processBundle(Session * session, WaveletData &wavelet, const QVariantMap &bundle);
+	QVariantList transformBundle(const WaveletData &wavelet, const QVariantList &operations, int version, const QByteArray &contributor) const;
+	bool applyOperation(WaveletData &wavelet, QVariantMap &op, const QByteArray &contributor, quint64 timestamp, QVariantMap &newBlips);
+
+	void sendFrame(Session * session, const QByteArray &command, const QMap<QByteArray, QByteArray> &headers, const QByteArray &body, bool lossy);
+	void sendMessages(Session * session, const QByteArray &target, const QVariantList &messages);
+	void sendMessage(Session * session, const QByteArray &target, const QString &type, const QVariant &property);
+	void broadcast(const QByteArray &waveletId, Session * except, const QString &type, const QVariant &property);
+
+	void createWave(const QString &title, const QByteArray &creator, int blips);
+	QByteArray createWavelet(const QByteArray &waveId, const QString &title, const QByteArray &creator, bool isRoot, int blips);
+	QVariantMap waveletDict(const WaveletData &wavelet) const;
+	QVariantMap waveletDictsOfWave(const QByteArray &waveId, const QByteArray &viewerId) const;
+	QVariantMap participantDict(const QByteArray &id) const;
+	QVariantMap blipsums(const WaveletData &wavelet) const;
+
+	static QByteArray deflate(const QByteArray &data);
+	static QByteArray inflate(const QByteArray &data);
+	static quint64 timestamp();
+	static QByteArray newKey();
+
+	Options m_options;
+	QTcpServer * server;
+	QTimer * deliveryTimer;
+	QJson::Serializer * jserializer;
+	QJson::Parser * jparser;
+
+	QMap<QTcpSocket*, Session*> m_sessions;
+	QMap<QByteArray, WaveletData> m_wavelets;
+	QMap<QByteArray, QList<QByteArray> > m_waves;
+	QSet<QByteArray> m_participants;
+	QMap<QPair<qint64, int>, Delivery> m_deliveries; // (due time, sequence)
+	int m_nextId;
+	quint64 m_receivedBundles;
+};
+
+#endif // MOCKBROKER_H
@@ -0,0 +1,87 @@
+/*
+ * This file is part of the PyGoWave Qt/C++ Client API
+ *
+ * Copyright (C) 2009 Patrick Schneider <patrick.p2k.schneider@googlemail.com>
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; see the file
+ * COPYING.LESSER.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include <QtCore/QFile>
+
+#include <PyGoWaveApi/controller.h>
+#include <PyGoWaveApi/recorder.h>
+
+using namespace PyGoWave;
+
+static QByteArray residentSetSize()
+{
+#ifdef Q_OS_LINUX
+	QFile status("/proc/self/status");
+	if (status.open(QIODevice::ReadOnly)) {
+		foreach (QByteArray line, status.readAll().split('\n')) {
+			if (line.startsWith("VmRSS:"))
+				return line.mid(6).trimmed();
+		}
+	}
+#endif
+	return "n/a";
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QTextStream out(stdout);
+
+	QStringList args = app.arguments();
+	args.removeFirst();
+	bool realTime = args.removeAll("--realtime") > 0;
+	if (args.size() != 1) {
+		out << "Usage: pygowave_replay [--realtime] <recording>" << endl;
+		return 1;
+	}
+
+	Controller controller;
+	FrameReplayer replayer(&controller);
+	if (!replayer.load(args.at(0)))
+		return 1;
+	replayer.setRealTime(realTime);
+	QObject::connect(&replayer, SIGNAL(finished()), &app, SLOT(quit()));
+
+	out << "Replaying " << replayer.frameCount() << " frames from " << args.at(0) << "..." << endl;
+	quint64 start = monotonicMicroseconds();
+	replayer.start();
+	if (realTime)
+		app.exec();
+	quint64 wall = monotonicMicroseconds() - start;
+
+	Histogram apply = replayer.frameApplyTime();
+	ControllerMetrics metrics = controller.metrics();
+	out << "Inbound frames:   " << replayer.replayedFrames() << endl;
+	out << "Dropped frames:   " << replayer.droppedFrames() << endl;
+	out << "Apply time:       " << replayer.totalApplyTime() / 1000.0 << " ms total, "
+		<< apply.mean() << " us mean, " << apply.percentile(95) << " us p95, "
+		<< apply.maximum() << " us max" << endl;
+	out << "JSON parse time:  " << metrics.jsonParseTime.mean() << " us mean, "
+		<< metrics.jsonParseTime.percentile(95) << " us p95" << endl;
+	out << "Bytes processed:  " << metrics.bytesIn << endl;
+	out << "Wall time:        " << wall / 1000.0 << " ms" << endl;
+	out << "Resident memory:  " << residentSetSize() << endl;
+
+	return 0;
+}
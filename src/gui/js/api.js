@@ -203,6 +203,12 @@ pygowave.api = $defined(pygowave.api) ? pygowave.api : new Hash();
 		content: function () {
 			return this._cpp.content;
 		},
+		contentLength: function () {
+			return this._cpp.contentLength;
+		},
+		contentMid: function (index, length) {
+			return this._cpp.contentMid(index, $defined(length) ? length : -1);
+		},
 		lastModified: function () {
 			return this._cpp.lastModified;
 		},
@@ -274,6 +280,7 @@ pygowave.api = $defined(pygowave.api) ? pygowave.api : new Hash();
 			this.addEvent("elementSetUserpref", pygowave.api.cpp.elementSetUserpref);
 			this.addEvent("deleteBlip", pygowave.api.cpp.deleteBlip);
 			this.addEvent("draftBlip", pygowave.api.cpp.draftBlip);
+			this.addEvent("blipEditorCreated", this._onBlipEditorCreated.bind(this));
 
 			this._wave = jswrapper.objects.get(WaveModel, waveId);
 			this._wavelet = this._wave.wavelet(waveletId);
@@ -295,9 +302,16 @@ pygowave.api = $defined(pygowave.api) ? pygowave.api : new Hash();
 				this._onBlipInserted(i, blipIds[i]);
 		},
 
+		blipById: function (id) {
+			return this._wavelet.blipById(id);
+		},
+
 		_onBlipInserted: function (index, blip_id) {
-			var blip = this._wavelet.blipByIndex(index);
-			var editor = this._blipContainerWidget.insertBlip(index, blip);
+			// The Blip is only requested once its editor is built
+			this._blipContainerWidget.insertBlip(index, blip_id, index == 0 || blip_id.startswith("TBD_"));
+		},
+		_onBlipEditorCreated: function (blip_id, editor) {
+			var blip = editor.blip();
 			this._blipEditors.set(blip_id, editor);
 			editor.addEvents({
 				blipEditing: this._onBlipEditing,
@@ -305,15 +319,17 @@ pygowave.api = $defined(pygowave.api) ? pygowave.api : new Hash();
 				deleteBlip: this._onDeleteBlip
 			});
 			blip.addEvent('idChanged', this._onBlipIdChanged);
-			if (blip.id().startswith("TBD_") || (blip.isRoot() && blip.content().length == 0)) {
+			if (blip.id().startswith("TBD_") || (blip.isRoot() && blip.contentLength() == 0)) {
 				editor.editBlip();
 				new Fx.Scroll(window).toBottom();
 			}
 		},
 		_onBlipDeleted: function (blipId) {
 			var editor = this._blipEditors.get(blipId);
-			if (!$defined(editor))
+			if (!$defined(editor)) {
+				this._blipContainerWidget.deleteBlip(blipId); // Only a placeholder
 				return;
+			}
 			if (editor == this._activeBlipEditor)
 				this._activeBlipEditor.finishBlip();
 			this._blipEditors.erase(blipId);
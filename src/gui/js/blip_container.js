@@ -34,36 +34,101 @@ pygowave.view = $defined(pygowave.view) ? pygowave.view : new Hash();
 			this._view = view;
 			var contentElement = new Element('div', {'class': 'blip_container_widget'});
 			this.parent(parentElement, contentElement);
-			this._blips = [];
+			this._blips = []; // Entries with the Blip's id and its editor or placeholder
 			this._rootBlip = null;
+			this._showPending = false;
+			this._showVisible = this._showVisible.bind(this);
+			$(window).addEvents({
+				scroll: this._showVisible,
+				resize: this._showVisible
+			});
 		},
 
-		insertBlip: function (index, blip) {
-			var where = 'bottom';
-			var parentElement = this.contentElement;
-			if (index != this._blips.length) {
-				where = 'before';
-				parentElement = this._blips[index];
+		/**
+		 * Inserts the Blip with the given ID at index. Its editor is built
+		 * once it comes near the visible area, until then a placeholder
+		 * takes its place and the Blip is not requested from the model.
+		 *
+		 * @function {public} insertBlip
+		 * @param {int} index Position of the Blip
+		 * @param {String} blipId ID of the Blip
+		 * @param {optional bool} immediate Build the editor right away
+		 */
+		insertBlip: function (index, blipId, immediate) {
+			var entry = {
+				id: blipId,
+				editor: null,
+				placeholder: new Element('div', {'class': 'blip_placeholder'})
+			};
+			if (index < this._blips.length)
+				entry.placeholder.inject(this._entryElement(this._blips[index]), 'before');
+			else
+				entry.placeholder.inject(this.contentElement, 'bottom');
+			this._blips.insert(index, entry);
+
+			if (immediate)
+				this._buildEditor(entry);
+			else if (!this._showPending) {
+				// Check once after a batch of insertions
+				this._showPending = true;
+				this._showVisible.delay(1);
 			}
-			
-			var blipwgt = new BlipEditorWidget(this._view, blip, parentElement, where);
-			this._blips.insert(index, blipwgt);
-			
-			if (blip.isRoot())
-				this._rootBlip = blipwgt;
-			
-			return blipwgt;
 		},
 
 		deleteBlip: function (id) {
 			for (var i = 0; i < this._blips.length; i++) {
-				var blipwgt = this._blips[i];
-				if (blipwgt.blip().id() == id) {
-					this._blips.pop(i);
-					blipwgt.destroy();
+				var entry = this._blips[i];
+				if (this._entryId(entry) == id) {
+					this._blips.splice(i, 1);
+					if ($defined(entry.editor)) {
+						if (entry.editor == this._rootBlip)
+							this._rootBlip = null;
+						entry.editor.destroy();
+					}
+					else
+						entry.placeholder.destroy();
 					break;
 				}
 			}
+			this._showVisible();
+		},
+
+		_entryId: function (entry) {
+			// Editors follow ID changes of their Blip
+			return $defined(entry.editor) ? entry.editor.blip().id() : entry.id;
+		},
+		_entryElement: function (entry) {
+			return $defined(entry.editor) ? entry.editor.contentElement : entry.placeholder;
+		},
+		_buildEditor: function (entry) {
+			var blipwgt = new BlipEditorWidget(this._view, this._view.blipById(entry.id), entry.placeholder, 'before');
+			entry.placeholder.destroy();
+			entry.placeholder = null;
+			entry.editor = blipwgt;
+
+			if (blipwgt.blip().isRoot())
+				this._rootBlip = blipwgt;
+
+			this._view.fireEvent('blipEditorCreated', [entry.id, blipwgt]);
+			return blipwgt;
+		},
+		/**
+		 * Builds the editors of all placeholders up to one screen below the
+		 * visible area.
+		 *
+		 * @function {private} _showVisible
+		 */
+		_showVisible: function () {
+			this._showPending = false;
+			var bottom = window.getScroll().y + 2 * window.getSize().y;
+			for (var i = 0; i < this._blips.length; i++) {
+				var entry = this._blips[i];
+				if ($defined(entry.editor))
+					continue;
+				if (entry.placeholder.getPosition().y > bottom)
+					break;
+				this._buildEditor(entry);
+			}
 		}
 	});
 	
@@ -94,6 +94,7 @@ pygowave.view = $defined(pygowave.view) ? pygowave.view : new Hash();
 				'spellcheck': 'false'
 			});
 			
+			this._onChangesApplied = this._onChangesApplied.bind(this);
 			this._onInsertedText = this._onInsertedText.bind(this);
 			this._onDeletedText = this._onDeletedText.bind(this);
 			this._onInsertedElement = this._onInsertedElement.bind(this);
@@ -142,13 +143,8 @@ pygowave.view = $defined(pygowave.view) ? pygowave.view : new Hash();
 			var ok = this.reloadContent();
 			
 			blip.addEvents({
-				insertedText: this._onInsertedText,
-				deletedText: this._onDeletedText,
-				outOfSync: this._onOutOfSync,
-				insertedElement: this._onInsertedElement,
-				deletedElement: this._onDeletedElement,
-				lastModifiedChanged: this._onLastModifiedChanged,
-				contributorAdded: this._onContributorAdded
+				changesApplied: this._onChangesApplied,
+				outOfSync: this._onOutOfSync
 			});
 			
 			this.contentElement.addEvents({
@@ -185,11 +181,8 @@ pygowave.view = $defined(pygowave.view) ? pygowave.view : new Hash();
 				it.next().removeEvent("dataChanged", this._updateContributorNames);
 			this._contributorObjects.empty();
 			this._blip.removeEvents({
-				insertedText: this._onInsertedText,
-				deletedText: this._onDeletedText,
-				outOfSync: this._onOutOfSync,
-				insertedElement: this._onInsertedElement,
-				deletedElement: this._onDeletedElement
+				changesApplied: this._onChangesApplied,
+				outOfSync: this._onOutOfSync
 			});
 			this.contentElement.removeEvents({
 				keydown: this._onKeyDown,
@@ -375,7 +368,7 @@ pygowave.view = $defined(pygowave.view) ? pygowave.view : new Hash();
 			this._editing = true;
 			this.fireEvent("blipEditing", this._blip.id());
 			this.contentElement.focus();
-			var ret = this._walkDown(this.contentElement, this._blip.content().length);
+			var ret = this._walkDown(this.contentElement, this._blip.contentLength());
 			var sel = new Selection(ret[0], ret[1], ret[0], ret[1]);
 			sel.select();
 			this._lastRange = this.currentTextRange(this.contentElement);
@@ -766,6 +759,38 @@ pygowave.view = $defined(pygowave.view) ? pygowave.view : new Hash();
 				new Element("br").inject(elt);
 		},
 		
+		/**
+		 * Callback from model with a set of changes to the Blip. Each change
+		 * is passed on to the callback of the same name.
+		 *
+		 * @function {private} _onChangesApplied
+		 * @param {Array} changes Change objects with a 'type' and arguments
+		 */
+		_onChangesApplied: function (changes) {
+			for (var i = 0; i < changes.length; i++) {
+				var c = changes[i];
+				switch (c.type) {
+					case "insertedText":
+						this._onInsertedText(c.index, c.text);
+						break;
+					case "deletedText":
+						this._onDeletedText(c.index, c.length);
+						break;
+					case "insertedElement":
+						this._onInsertedElement(c.index);
+						break;
+					case "deletedElement":
+						this._onDeletedElement(c.index);
+						break;
+					case "lastModifiedChanged":
+						this._onLastModifiedChanged(c.datetime);
+						break;
+					case "contributorAdded":
+						this._onContributorAdded(c.id);
+						break;
+				}
+			}
+		},
 		/**
 		 * Callback from model on text insertion
 		 *
@@ -36,11 +36,13 @@
 #include <QtGui/QFocusEvent>
 #include <QtCore/QSettings>
 #include <QtGui/QDesktopWidget>
+#include <QtGui/QDesktopServices>
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow)
 {
 	this->controller = new PyGoWave::Controller(this);
 	this->controller->setObjectName("controller");
+	this->controller->setCacheDirectory(QDesktopServices::storageLocation(QDesktopServices::CacheLocation));
 	this->indicator = new OnlineStateIndicator(this);
 	this->indicator->setObjectName("indicator");
 
@@ -54,6 +56,13 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
 	this->ui->statusBar->showMessage(tr("Welcome!"), 5000);
 
 	QSettings settings;
+	if (settings.contains("RecordFramesTo")) { // Debugging aid, see PyGoWaveReplay
+		PyGoWave::FrameRecorder * recorder = new PyGoWave::FrameRecorder(this);
+		if (recorder->open(settings.value("RecordFramesTo").toString()))
+			this->controller->setFrameRecorder(recorder);
+	}
+	this->controller->setOfflineEditing(settings.value("OfflineEditing", true).toBool());
+	this->controller->setIdleUnsubscribeTimeout(settings.value("IdleUnsubscribeTimeout", 900).toInt());
 	delete this->ui->placeholderTab;
 	if (settings.contains("WindowState"))
 		this->restoreState(settings.value("WindowState").toByteArray());
@@ -110,11 +110,21 @@ void WaveletWidget::changeEvent(QEvent *e)
     case QEvent::LanguageChange:
 		this->ui->retranslateUi(this);
         break;
+	case QEvent::ActivationChange:
+		if (this->isActiveWindow())
+			this->m_controller->markWaveletViewed(this->m_wavelet->id());
+		break;
     default:
         break;
     }
 }
 
+void WaveletWidget::showEvent(QShowEvent *e)
+{
+	QWidget::showEvent(e);
+	this->m_controller->markWaveletViewed(this->m_wavelet->id()); // E.g. its tab was selected
+}
+
 void WaveletWidget::closeEvent(QCloseEvent *e)
 {
 	emit closing(this->m_wavelet->id());
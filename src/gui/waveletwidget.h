@@ -59,6 +59,7 @@ signals:
 
 protected:
     void changeEvent(QEvent *e);
+	void showEvent(QShowEvent *e);
 	void closeEvent(QCloseEvent *e);
 	void resizeEvent(QResizeEvent *e);
 
@@ -108,7 +108,7 @@ JSWrapper * JavaScriptAPI::createWrapper(const QString &className, const QString
 		Wavelet * w = this->m_controller->wavelet(ids[2].toAscii());
 		if (w) {
 			Blip * b = w->blipById(ids[1].toAscii());
-			if (b) {
+			if (b && b->elementTypeById(ids[0].toInt()) == Element::GADGET) {
 				GadgetElement * g = qobject_cast<GadgetElement*>(b->elementById(ids[0].toInt()));
 				if (g)
 					return new GadgetElementWrapper(this->m_webFrame, g, parent);
@@ -258,9 +258,10 @@ QString WaveletWrapper::blipByIndex(int index) const
 
 QStringList WaveletWrapper::allBlips() const
 {
+	// Only the IDs; the Blip objects are created when the page asks for them
 	QStringList ids;
-	foreach (Blip * b, this->m_wavelet->allBlips())
-		ids << QString::fromAscii(b->id());
+	foreach (QByteArray id, this->m_wavelet->allBlipIDs())
+		ids << QString::fromAscii(id);
 	return ids;
 }
 
@@ -300,21 +301,19 @@ void WaveletWrapper::lastModifiedChanged(const QDateTime &datetime)
 BlipWrapper::BlipWrapper(QWebFrame * webFrame, Blip * blip, JSWrapper * parent) : JSWrapper(webFrame, blip, QString::fromAscii(blip->id()), parent)
 {
 	this->m_blip = blip;
-	connect(blip, SIGNAL(deletedElement(int)), this, SLOT(deletedElement(int)));
-	connect(blip, SIGNAL(deletedText(int,int)), this, SLOT(deletedText(int,int)));
-	connect(blip, SIGNAL(insertedElement(int)), this, SLOT(insertedElement(int)));
-	connect(blip, SIGNAL(insertedText(int,QString)), this, SLOT(insertedText(int,QString)));
+	// One call into the page per change set instead of one per change
+	connect(blip, SIGNAL(changesApplied(QVariantList)), this, SLOT(changesApplied(QVariantList)));
 	connect(blip, SIGNAL(outOfSync()), this, SLOT(outOfSync()));
-	connect(blip, SIGNAL(lastModifiedChanged(QDateTime)), this, SLOT(lastModifiedChanged(QDateTime)));
 	connect(blip, SIGNAL(idChanged(QByteArray,QByteArray)), this, SLOT(idChanged(QByteArray,QByteArray)));
-	connect(blip, SIGNAL(contributorAdded(QByteArray)), this, SLOT(contributorAdded(QByteArray)));
 }
 
+// The Element objects are only created for a GadgetElementWrapper
+
 QString BlipWrapper::elementAt(int index) const
 {
-	Element * e = this->m_blip->elementAt(index);
-	if (e)
-		return QString::number(e->id());
+	QList<int> ids = this->m_blip->elementIdsWithin(index, index + 1);
+	if (!ids.isEmpty())
+		return QString::number(ids.first());
 	else
 		return QString();
 }
@@ -322,16 +321,16 @@ QString BlipWrapper::elementAt(int index) const
 QStringList BlipWrapper::elementsWithin(int start, int end) const
 {
 	QStringList ids;
-	foreach (Element * e, this->m_blip->elementsWithin(start, end))
-		ids << QString::number(e->id());
+	foreach (int id, this->m_blip->elementIdsWithin(start, end))
+		ids << QString::number(id);
 	return ids;
 }
 
 QStringList BlipWrapper::allElements() const
 {
 	QStringList ids;
-	foreach (Element * e, this->m_blip->allElements())
-		ids << QString::number(e->id());
+	foreach (int id, this->m_blip->allElementIds())
+		ids << QString::number(id);
 	return ids;
 }
 
@@ -348,28 +347,11 @@ QString BlipWrapper::creator() const
 	return QString::fromAscii(this->m_blip->creator()->id());
 }
 
-void BlipWrapper::deletedElement(int index)
-{
-	this->forwardSignal("deletedElement", index);
-}
-
-void BlipWrapper::deletedText(int index, int length)
-{
-	QVariantList args;
-	args << index << length;
-	this->forwardSignal("deletedText", args);
-}
-
-void BlipWrapper::insertedElement(int index)
-{
-	this->forwardSignal("insertedElement", index);
-}
-
-void BlipWrapper::insertedText(int index, const QString &text)
+void BlipWrapper::changesApplied(const QVariantList &changes)
 {
 	QVariantList args;
-	args << index << text;
-	this->forwardSignal("insertedText", args);
+	args << QVariant(changes);
+	this->forwardSignal("changesApplied", args);
 }
 
 void BlipWrapper::outOfSync()
@@ -377,11 +359,6 @@ void BlipWrapper::outOfSync()
 	this->forwardSignal("outOfSync");
 }
 
-void BlipWrapper::lastModifiedChanged(const QDateTime &datetime)
-{
-	this->forwardSignal("lastModifiedChanged", toTimestamp(datetime));
-}
-
 void BlipWrapper::idChanged(const QByteArray &oldId, const QByteArray &newId)
 {
 	QVariantList args;
@@ -390,11 +367,6 @@ void BlipWrapper::idChanged(const QByteArray &oldId, const QByteArray &newId)
 	this->forwardSignal("idChanged", args);
 }
 
-void BlipWrapper::contributorAdded(const QByteArray &id)
-{
-	this->forwardSignal("contributorAdded", QString::fromAscii(id));
-}
-
 
 GadgetElementWrapper::GadgetElementWrapper(QWebFrame * webFrame, GadgetElement * gadget, JSWrapper * parent) : JSWrapper(webFrame, gadget, QString::number(gadget->id()), parent)
 {
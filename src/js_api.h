@@ -158,14 +158,9 @@ namespace PyGoWave {
 		QString creator() const;
 
 	private slots:
-		void deletedElement(int);
-		void deletedText(int, int);
-		void insertedElement(int);
-		void insertedText(int, const QString &);
+		void changesApplied(const QVariantList &changes);
 		void outOfSync();
-		void lastModifiedChanged(const QDateTime &);
 		void idChanged(const QByteArray &oldId, const QByteArray &newId);
-		void contributorAdded(const QByteArray &id);
 
 	private:
 		Blip * m_blip;